@@ -226,6 +226,33 @@
  */
 #define MCE_VERSION_GET			"get_version"
 
+/**
+ * Set the log verbosity
+ *
+ * @since v1.9.17
+ * @param verbosity @c dbus_int32_t with the highest loglevel to log,
+ *                  from 0 (nothing) to 5 (debug)
+ */
+#define MCE_LOG_VERBOSITY_SET		"set_log_verbosity"
+
+/**
+ * Make the log call sites matching a pattern log regardless of verbosity;
+ * adding a pattern twice has no effect, and at most 32 patterns are kept
+ * until they are cleared
+ *
+ * @since v1.9.17
+ * @param pattern @c gchar @c * with a shell wildcard pattern matched
+ *                against "file:function", for example "display.c:*"
+ */
+#define MCE_LOG_PATTERN_ADD_REQ		"req_log_pattern_add"
+
+/**
+ * Remove all log call site patterns
+ *
+ * @since v1.9.17
+ */
+#define MCE_LOG_PATTERNS_CLEAR_REQ	"req_log_patterns_clear"
+
 /**
  * Unblank display
  *
@@ -247,6 +274,17 @@
  */
 #define MCE_DISPLAY_OFF_REQ		"req_display_state_off"
 
+/**
+ * Set the power state of an external display output
+ *
+ * @since v1.9.17
+ * @param output_name @c gchar @c * with the DRM connector name,
+ *                    for instance "HDMI-A-1"
+ * @param state @c gchar @c * with the state, either
+ *              @c MCE_DISPLAY_ON_STRING or @c MCE_DISPLAY_OFF_STRING
+ */
+#define MCE_DISPLAY_OUTPUT_STATE_REQ	"req_display_output_state"
+
 /**
  * Prevent display from blanking
  *
@@ -254,6 +292,47 @@
  */
 #define MCE_PREVENT_BLANK_REQ		"req_display_blanking_pause"
 
+/**
+ * Inhibit display dimming and/or blanking on behalf of an application;
+ * a new request from the same application replaces the previous one
+ *
+ * @since v1.9.17
+ * @param app_id @c gchar @c * with the application ID
+ * @param reason @c gchar @c * with a human readable reason
+ * @param type @c gchar @c * with the inhibit type, either
+ *             @c MCE_INHIBIT_DIM_ONLY_STRING or
+ *             @c MCE_INHIBIT_NO_BLANK_STRING
+ * @param timeout @c dbus_uint32_t with the expiry in seconds,
+ *                0 to inhibit until cancelled or the caller exits
+ * @return @c dbus_bool_t @c TRUE if the inhibit was granted,
+ *         @c FALSE if it was refused, for instance because the
+ *         application has used up its budget
+ */
+#define MCE_DISPLAY_INHIBIT_REQ		"req_display_inhibit"
+
+/**
+ * Cancel an application's display inhibit
+ *
+ * @since v1.9.17
+ * @param app_id @c gchar @c * with the application ID
+ */
+#define MCE_DISPLAY_INHIBIT_CANCEL_REQ	"req_display_inhibit_cancel"
+
+/**
+ * Query the display inhibits and the screen-on time attributed to them
+ *
+ * @since v1.9.17
+ * @return array of struct with
+ *         @c gchar @c * application ID,
+ *         @c gchar @c * reason of the latest request,
+ *         @c gchar @c * inhibit type,
+ *         @c dbus_bool_t @c TRUE if the inhibit is in effect,
+ *         @c dbus_int64_t total screen-on time in ms,
+ *         @c dbus_int64_t screen-on time in ms in the current budget period,
+ *         @c dbus_int32_t budget in seconds per period, 0 if unlimited
+ */
+#define MCE_DISPLAY_INHIBITORS_GET	"get_display_inhibitors"
+
 /**
  * Prevent keypad off
  *
@@ -394,6 +473,35 @@
  */
 #define MCE_DISPLAY_SIG			"display_status_ind"
 
+/**
+ * Notify everyone about the progress of a display state change
+ *
+ * Sent once the change has been applied to the hardware,
+ * and again when the brightness fade has completed, if that is later.
+ * Timestamps are CLOCK_MONOTONIC in microseconds, 0 if not yet reached
+ *
+ * @since v1.9.17
+ * @return @c gchar @c * with the requested display state,
+ *         @c gchar @c * with the display state achieved so far,
+ *         @c dbus_uint32_t sequence number of the change,
+ *         @c dbus_int64_t time the change was requested,
+ *         @c dbus_int64_t time of the first backlight write,
+ *         @c dbus_int64_t time the brightness fade completed
+ *         (see @ref mce/mode-names.h for valid display states)
+ */
+#define MCE_DISPLAY_EXT_SIG		"display_status_ext_ind"
+
+/**
+ * Notify everyone that an external display output has been
+ * powered on or off, or has been connected or disconnected
+ *
+ * @since v1.9.17
+ * @return @c gchar @c * with the DRM connector name,
+ *         @c gchar @c * with the output state
+ *         (see @ref mce/mode-names.h for valid display states)
+ */
+#define MCE_DISPLAY_OUTPUT_SIG		"display_output_status_ind"
+
 /**
  * Notify everyone that the system is active/inactive
  *
@@ -82,6 +82,11 @@
 /** Display state name for display off */
 #define MCE_DISPLAY_OFF_STRING			"off"
 
+/** Display inhibit type that allows dimming but not blanking */
+#define MCE_INHIBIT_DIM_ONLY_STRING		"dim-only"
+/** Display inhibit type that allows neither dimming nor blanking */
+#define MCE_INHIBIT_NO_BLANK_STRING		"no-blank"
+
 /** Keyboard state name for keyboard light on */
 #define MCE_KEYBOARD_ON_STRING			"on"
 /** Keyboard state name for keyboard light off */
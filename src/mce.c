@@ -20,6 +20,7 @@
  * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <glib.h>
+#include <glib-unix.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -31,6 +32,7 @@
 #include <sys/stat.h>
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-io.h"
 #include "mce-conf.h"
 #include "mce-dbus.h"
 #include "mce-modules.h"
@@ -65,6 +67,8 @@ datapipe_struct led_pattern_activate_pipe;
 datapipe_struct led_pattern_deactivate_pipe;
 /** LED enabled / disabled */
 datapipe_struct led_enabled_pipe;
+/** Vibrator enabled / disabled */
+datapipe_struct vibrator_enabled_pipe;
 datapipe_struct vibrator_pattern_activate_pipe;
 datapipe_struct vibrator_pattern_deactivate_pipe;
 /** State of display; read only */
@@ -120,12 +124,30 @@ datapipe_struct camera_button_pipe;
 datapipe_struct inactivity_timeout_pipe;
 /** Audio routing state; read only */
 datapipe_struct audio_route_pipe;
+/** Audio output device class; read only */
+datapipe_struct audio_output_pipe;
 /** USB cable has been connected/disconnected; read only */
 datapipe_struct usb_cable_pipe;
 datapipe_struct tvout_pipe;
+/** Display blanking inhibited, dimming allowed; read only */
+datapipe_struct blank_inhibit_pipe;
 
 GMainLoop *mainloop;
 
+#ifdef ENABLE_SYSTEMD_SUPPORT
+/** Notify systemd of the startup progress? */
+static gboolean systemd_notify = FALSE;
+#endif
+
+/** Has the input device handling been initialised? */
+static gboolean input_initialised = FALSE;
+
+/** ID for the deferred startup idle source */
+static guint deferred_startup_cb_id = 0;
+
+/** Exit status set by the deferred startup */
+static gint deferred_startup_status = 0;
+
 /**
  * Display usage information
  */
@@ -209,31 +231,223 @@ EXIT:
 	return status;
 }
 
+/** A datapipe and its name, for the state dump */
+typedef struct {
+	const gchar *name;		/**< Name of the datapipe */
+	const datapipe_struct *datapipe;	/**< The datapipe */
+} datapipe_entry_t;
+
+/** Datapipe table entry */
+#define DATAPIPE_ENTRY(_datapipe)	{ #_datapipe, &_datapipe }
+
+/** All datapipes, for the state dump */
+static const datapipe_entry_t datapipes[] = {
+	DATAPIPE_ENTRY(system_state_pipe),
+	DATAPIPE_ENTRY(system_power_request_pipe),
+	DATAPIPE_ENTRY(mode_pipe),
+	DATAPIPE_ENTRY(submode_pipe),
+	DATAPIPE_ENTRY(call_state_pipe),
+	DATAPIPE_ENTRY(call_type_pipe),
+	DATAPIPE_ENTRY(alarm_ui_state_pipe),
+	DATAPIPE_ENTRY(display_state_pipe),
+	DATAPIPE_ENTRY(display_brightness_pipe),
+	DATAPIPE_ENTRY(blank_inhibit_pipe),
+	DATAPIPE_ENTRY(device_inactive_pipe),
+	DATAPIPE_ENTRY(inactivity_timeout_pipe),
+	DATAPIPE_ENTRY(tk_lock_pipe),
+	DATAPIPE_ENTRY(device_lock_pipe),
+	DATAPIPE_ENTRY(device_lock_inhibit_pipe),
+	DATAPIPE_ENTRY(led_enabled_pipe),
+	DATAPIPE_ENTRY(led_pattern_activate_pipe),
+	DATAPIPE_ENTRY(led_pattern_deactivate_pipe),
+	DATAPIPE_ENTRY(vibrator_enabled_pipe),
+	DATAPIPE_ENTRY(vibrator_pattern_activate_pipe),
+	DATAPIPE_ENTRY(vibrator_pattern_deactivate_pipe),
+	DATAPIPE_ENTRY(keypress_pipe),
+	DATAPIPE_ENTRY(touchscreen_pipe),
+	DATAPIPE_ENTRY(touchscreen_suspend_pipe),
+	DATAPIPE_ENTRY(lockkey_pipe),
+	DATAPIPE_ENTRY(keyboard_slide_pipe),
+	DATAPIPE_ENTRY(lid_cover_pipe),
+	DATAPIPE_ENTRY(lens_cover_pipe),
+	DATAPIPE_ENTRY(proximity_sensor_pipe),
+	DATAPIPE_ENTRY(light_sensor_pipe),
+	DATAPIPE_ENTRY(camera_button_pipe),
+	DATAPIPE_ENTRY(charger_state_pipe),
+	DATAPIPE_ENTRY(battery_status_pipe),
+	DATAPIPE_ENTRY(usb_cable_pipe),
+	DATAPIPE_ENTRY(tvout_pipe),
+	DATAPIPE_ENTRY(audio_route_pipe),
+	DATAPIPE_ENTRY(audio_output_pipe),
+	{ NULL, NULL }
+};
+
+/**
+ * Log the state of MCE, for diagnostics
+ */
+static void mce_dump_state(void)
+{
+	mce_log(LL_DUMP, "State dump of MCE " G_STRINGIFY(PRG_VERSION));
+
+	for (gint i = 0; datapipes[i].name != NULL; i++) {
+		const datapipe_struct *datapipe = datapipes[i].datapipe;
+
+		if (datapipe->datasize == 0)
+			mce_log(LL_DUMP, "  %s = %d; %u/%u/%u filters/triggers",
+				datapipes[i].name,
+				datapipe_get_gint(*datapipe),
+				datapipe_get_filter_refcount(*datapipe),
+				datapipe_get_input_trigger_refcount(*datapipe),
+				datapipe_get_output_trigger_refcount(*datapipe));
+		else
+			mce_log(LL_DUMP, "  %s = %s; %u/%u/%u filters/triggers",
+				datapipes[i].name,
+				datapipe->cached_data ? "<data>" : "<none>",
+				datapipe_get_filter_refcount(*datapipe),
+				datapipe_get_input_trigger_refcount(*datapipe),
+				datapipe_get_output_trigger_refcount(*datapipe));
+	}
+
+	mce_io_dump();
+	mce_dbus_dump();
+	mce_modules_dump();
+}
+
 /**
- * Signal handler
+ * Handler for SIGTERM and SIGINT, run from the mainloop
  *
- * @param signr Signal type
+ * @param data Unused
+ * @return Always returns TRUE, to keep the handler
  */
-static void signal_handler(const gint signr)
+static gboolean signal_quit_cb(gpointer data)
 {
-	switch (signr) {
-	case SIGUSR1:
-		/* We'll probably want some way to communicate with MCE */
-		break;
+	(void)data;
 
-	case SIGHUP:
-		/* Possibly for re-reading configuration? */
-		break;
+	g_main_loop_quit(mainloop);
 
-	case SIGTERM:
-	case SIGINT:
-		g_main_loop_quit(mainloop);
-		break;
+	return TRUE;
+}
 
-	default:
-		/* Should never happen */
-		break;
+/**
+ * Handler for SIGUSR1, run from the mainloop;
+ * dumps the state of MCE to the log
+ *
+ * @param data Unused
+ * @return Always returns TRUE, to keep the handler
+ */
+static gboolean signal_dump_cb(gpointer data)
+{
+	(void)data;
+
+	mce_dump_state();
+
+	return TRUE;
+}
+
+/**
+ * Handler for SIGHUP, run from the mainloop;
+ * re-reads the configuration
+ *
+ * @param data Unused
+ * @return Always returns TRUE, to keep the handler
+ */
+static gboolean signal_reload_cb(gpointer data)
+{
+	(void)data;
+
+	mce_log(LL_INFO, "Reloading configuration");
+
+	if (mce_conf_reload() == FALSE)
+		mce_log(LL_WARN, "Failed to reload configuration; "
+			"keeping the previous configuration");
+
+	mce_modules_reload();
+
+	return TRUE;
+}
+
+/**
+ * Report startup progress to the log, and to systemd
+ *
+ * @param status The progress
+ */
+static void mce_startup_status(const gchar *const status)
+{
+	mce_log(LL_INFO, "Startup: %s", status);
+
+#ifdef ENABLE_SYSTEMD_SUPPORT
+	if (systemd_notify == TRUE)
+		sd_notifyf(0, "STATUS=%s", status);
+#endif
+}
+
+/**
+ * Initialise the input device handling
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_startup_input(void)
+{
+	mce_startup_status("probing input devices");
+
+	if (mce_input_init() == FALSE) {
+		mce_log(LL_CRIT, "Failed to initialise mce-input");
+		return FALSE;
+	}
+
+	input_initialised = TRUE;
+
+	return TRUE;
+}
+
+/**
+ * Bring up the rest of MCE after readiness has been signalled;
+ * one step per mainloop iteration, so that D-Bus queries to the
+ * modules already loaded are served in between
+ *
+ * @param data Unused
+ * @return TRUE while there are steps left, FALSE when done
+ */
+static gboolean deferred_startup_cb(gpointer data)
+{
+	const gchar *name;
+	gchar *status;
+
+	(void)data;
+
+	if (input_initialised == FALSE) {
+		if (mce_startup_input() == FALSE)
+			goto FAIL;
+
+		return TRUE;
 	}
+
+	if ((name = mce_modules_get_pending()) != NULL) {
+		status = g_strdup_printf("loading module %s", name);
+		mce_startup_status(status);
+		g_free(status);
+
+		if (mce_modules_load_pending() == FALSE) {
+			mce_log(LL_CRIT, "Failed to initialise mce-modules");
+			goto FAIL;
+		}
+
+		return TRUE;
+	}
+
+	deferred_startup_cb_id = 0;
+
+	mce_startup_ui();
+	mce_startup_status("running");
+
+	return FALSE;
+
+FAIL:
+	deferred_startup_cb_id = 0;
+	deferred_startup_status = EXIT_FAILURE;
+	g_main_loop_quit(mainloop);
+
+	return FALSE;
 }
 
 /**
@@ -398,9 +612,7 @@ int main(int argc, char **argv)
 	gint status = 0;
 	gboolean daemonflag = FALSE;
 	gboolean systembus = TRUE;
-#ifdef ENABLE_SYSTEMD_SUPPORT
-	gboolean systemd_notify = FALSE;
-#endif
+	gboolean early_ready;
 
 	const char optline[] = "dS";
 
@@ -511,10 +723,11 @@ int main(int argc, char **argv)
 	if (daemonflag == TRUE)
 		daemonize();
 
-	signal(SIGUSR1, signal_handler);
-	signal(SIGHUP, signal_handler);
-	signal(SIGTERM, signal_handler);
-	signal(SIGINT, signal_handler);
+	/* Handle signals from the mainloop rather than in signal context */
+	g_unix_signal_add(SIGUSR1, signal_dump_cb, NULL);
+	g_unix_signal_add(SIGHUP, signal_reload_cb, NULL);
+	g_unix_signal_add(SIGTERM, signal_quit_cb, NULL);
+	g_unix_signal_add(SIGINT, signal_quit_cb, NULL);
 
 	/* Initialise GType system */
 #if !GLIB_CHECK_VERSION(2,35,0)
@@ -534,6 +747,13 @@ int main(int argc, char **argv)
 	 */
 	(void)mce_conf_init();
 
+	/* Signal readiness once the core and the critical modules are up,
+	 * and bring up the rest from the mainloop
+	 */
+	early_ready = mce_conf_get_bool(MCE_CONF_MODULES_GROUP,
+					MCE_CONF_MODULES_EARLY_READY,
+					DEFAULT_MCE_EARLY_READY, NULL);
+
 	/* Initialise D-Bus */
 	if (mce_dbus_init(systembus) == FALSE) {
 		mce_log(LL_CRIT,
@@ -567,6 +787,8 @@ int main(int argc, char **argv)
 		       0, NULL);
 	setup_datapipe(&led_enabled_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(TRUE));
+	setup_datapipe(&vibrator_enabled_pipe, READ_WRITE, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(TRUE));
 	setup_datapipe(&vibrator_pattern_activate_pipe, READ_ONLY, FREE_CACHE,
 		       0, NULL);
 	setup_datapipe(&vibrator_pattern_deactivate_pipe, READ_ONLY, FREE_CACHE,
@@ -584,11 +806,14 @@ int main(int argc, char **argv)
 	setup_datapipe(&keyboard_slide_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(0));
 	setup_datapipe(&lid_cover_pipe, READ_ONLY, DONT_FREE_CACHE,
-		       0, GINT_TO_POINTER(0));
+		       0, GINT_TO_POINTER(COVER_UNDEF));
 	setup_datapipe(&lens_cover_pipe, READ_ONLY, DONT_FREE_CACHE,
-		       0, GINT_TO_POINTER(0));
+		       0, GINT_TO_POINTER(COVER_UNDEF));
+	/* Not covered until a proximity sensor reports otherwise;
+	 * the same state the sensor reports when it is released
+	 */
 	setup_datapipe(&proximity_sensor_pipe, READ_ONLY, DONT_FREE_CACHE,
-		       0, GINT_TO_POINTER(0));
+		       0, GINT_TO_POINTER(COVER_OPEN));
 	setup_datapipe(&light_sensor_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(-1));
 	setup_datapipe(&device_lock_pipe, READ_ONLY, DONT_FREE_CACHE,
@@ -607,10 +832,14 @@ int main(int argc, char **argv)
 		       0, GINT_TO_POINTER(DEFAULT_INACTIVITY_TIMEOUT));
 	setup_datapipe(&audio_route_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(AUDIO_ROUTE_UNDEF));
+	setup_datapipe(&audio_output_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(AUDIO_OUTPUT_UNDEF));
 	setup_datapipe(&usb_cable_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(0));
 	setup_datapipe(&tvout_pipe, READ_ONLY, DONT_FREE_CACHE,
                0, GINT_TO_POINTER(FALSE));
+	setup_datapipe(&blank_inhibit_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(FALSE));
 
 	/* Initialise connectivity monitoring
 	 * pre-requisite: g_type_init()
@@ -638,20 +867,22 @@ int main(int argc, char **argv)
 		goto EXIT;
 	}
 
-	if (mce_input_init() == FALSE) {
+	if ((early_ready == FALSE) && (mce_startup_input() == FALSE)) {
 		status = EXIT_FAILURE;
-		mce_log(LL_CRIT, "Failed to initialise mce-input");
 		goto EXIT;
 	}
 
-	/* Load all modules */
-	if (mce_modules_init() == FALSE) {
+	/* Load all modules, or only the critical ones */
+	mce_startup_status("loading modules");
+
+	if (mce_modules_init(early_ready) == FALSE) {
 		status = EXIT_FAILURE;
 		mce_log(LL_CRIT, "Failed to initialise mce-modules");
 		goto EXIT;
 	}
 
-	mce_startup_ui();
+	if (early_ready == FALSE)
+		mce_startup_ui();
 
 #ifdef ENABLE_SYSTEMD_SUPPORT
 	/* Tell systemd that we have started up */
@@ -661,18 +892,33 @@ int main(int argc, char **argv)
 	}
 #endif
 
+	if (early_ready == TRUE) {
+		mce_startup_status("ready; starting remaining services");
+		deferred_startup_cb_id = g_idle_add(deferred_startup_cb, NULL);
+	} else {
+		mce_startup_status("running");
+	}
+
 	/* Run the main loop */
 	g_main_loop_run(mainloop);
 
+	status = deferred_startup_status;
+
 	/* If we get here, the main loop has terminated;
 	 * either because we requested or because of an error
 	 */
 EXIT:
+	if (deferred_startup_cb_id != 0) {
+		g_source_remove(deferred_startup_cb_id);
+		deferred_startup_cb_id = 0;
+	}
+
 	/* Unload all modules */
 	mce_modules_exit();
 
 	/* Call the exit function for all components */
-	mce_input_exit();
+	if (input_initialised == TRUE)
+		mce_input_exit();
 	mce_powerkey_exit();
 	mce_mode_exit();
 
@@ -681,8 +927,10 @@ EXIT:
 #endif
 
 	/* Free all datapipes */
+	free_datapipe(&blank_inhibit_pipe);
 	free_datapipe(&tvout_pipe);
 	free_datapipe(&usb_cable_pipe);
+	free_datapipe(&audio_output_pipe);
 	free_datapipe(&audio_route_pipe);
 	free_datapipe(&inactivity_timeout_pipe);
 	free_datapipe(&battery_status_pipe);
@@ -701,6 +949,7 @@ EXIT:
 	free_datapipe(&keypress_pipe);
 	free_datapipe(&vibrator_pattern_deactivate_pipe);
 	free_datapipe(&vibrator_pattern_activate_pipe);
+	free_datapipe(&vibrator_enabled_pipe);
 	free_datapipe(&led_pattern_deactivate_pipe);
 	free_datapipe(&led_pattern_activate_pipe);
 	free_datapipe(&display_brightness_pipe);
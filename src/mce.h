@@ -91,6 +91,12 @@ typedef struct {
  * This value is only used when modules conflict
  */
 	const gint priority;
+/** System states the module is active in, as a mask of MCE_STATE_MASK();
+ * 0 if the module is active in all states. Modules that declare
+ * this may export mce_module_quiesce() and mce_module_resume(),
+ * called when the system enters and leaves the other states
+ */
+	const guint active_states;
 } module_info_struct;
 
 /** The GMainLoop used by MCE */
@@ -161,6 +167,9 @@ typedef enum {
 	MCE_STATE_BOOT = 9		/**< System is in bootup state */
 } system_state_t;
 
+/** Mask bit of a system state, for module_info_struct active_states */
+#define MCE_STATE_MASK(state)		(1u << (state))
+
 typedef enum {
 	MCE_POWER_REQ_UNDEF,
 	MCE_POWER_REQ_OFF,
@@ -259,6 +268,22 @@ typedef enum {
 	AUDIO_ROUTE_HEADSET = 2,
 } audio_route_t;
 
+/** Audio output device class */
+typedef enum {
+	/** Audio output not known */
+	AUDIO_OUTPUT_UNDEF = -1,
+	/** Audio played through the earpiece */
+	AUDIO_OUTPUT_EARPIECE = 0,
+	/** Audio played through the loudspeakers */
+	AUDIO_OUTPUT_SPEAKER = 1,
+	/** Audio played through a wired headset or headphones */
+	AUDIO_OUTPUT_WIRED = 2,
+	/** Audio played through a Bluetooth device */
+	AUDIO_OUTPUT_BLUETOOTH = 3,
+	/** Audio played through some other device, such as TV-out */
+	AUDIO_OUTPUT_OTHER = 4,
+} audio_output_t;
+
 /** USB cable state */
 typedef enum {
 	USB_CABLE_UNDEF = -1,		/**< Usb cable state not set */
@@ -274,6 +299,8 @@ extern datapipe_struct led_pattern_activate_pipe;
 extern datapipe_struct led_pattern_deactivate_pipe;
 /** LED enabled / disabled */
 extern datapipe_struct led_enabled_pipe;
+/** Vibrator enabled / disabled */
+extern datapipe_struct vibrator_enabled_pipe;
 extern datapipe_struct vibrator_pattern_activate_pipe;
 extern datapipe_struct vibrator_pattern_deactivate_pipe;
 /** State of display; read only */
@@ -329,9 +356,13 @@ extern datapipe_struct camera_button_pipe;
 extern datapipe_struct inactivity_timeout_pipe;
 /** Audio routing state; read only */
 extern datapipe_struct audio_route_pipe;
+/** Audio output device class; read only */
+extern datapipe_struct audio_output_pipe;
 /** USB cable has been connected/disconnected; read only */
 extern datapipe_struct usb_cable_pipe;
 extern datapipe_struct tvout_pipe;
+/** Display blanking inhibited, dimming allowed; read only */
+extern datapipe_struct blank_inhibit_pipe;
 
 extern guint16 power_keycode;
 
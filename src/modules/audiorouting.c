@@ -21,7 +21,6 @@
  */
 #include <glib.h>
 #include <gmodule.h>
-#include <string.h>
 #include "mce.h"
 #include "mce-log.h"
 #include "mce-dbus.h"
@@ -48,23 +47,37 @@ G_MODULE_EXPORT module_info_struct module_info = {
 /** D-Bus signal for actions from the policy framework */
 #define POLICY_AUDIO_ACTIONS		"audio_actions"
 
-/** Macro to access offsets in the action data struct */
-#define STRUCT_OFFSET(s, m)		((char *)&(((s *)0)->m) - (char *)0)
+/** Policy action for audio routes */
+#define POLICY_AUDIO_ROUTE_ACTION	"com.nokia.policy.audio_route"
 
-/** audio route arguments */
-struct argrt {
-	gchar *type;			/**< Audio route type */
-	gchar *device;			/**< Device */
-	gchar *mode;			/**< Mode */
-	gchar *hwid;			/**< Hardware ID */
+/** Audio route action arguments */
+typedef enum {
+	ROUTE_ARG_TYPE = 0,		/**< Audio route type */
+	ROUTE_ARG_DEVICE = 1,		/**< Device */
+	ROUTE_ARG_MODE = 2,		/**< Mode */
+	ROUTE_ARG_HWID = 3,		/**< Hardware ID */
+	ROUTE_ARG_COUNT			/**< Number of arguments */
+} route_arg_t;
+
+/** Names of the audio route action arguments */
+static const gchar *const route_arg_names[ROUTE_ARG_COUNT] = {
+	[ROUTE_ARG_TYPE] = "type",
+	[ROUTE_ARG_DEVICE] = "device",
+	[ROUTE_ARG_MODE] = "mode",
+	[ROUTE_ARG_HWID] = "hwid"
 };
 
-/** argument descriptor for actions */
-struct argdsc {
-	const gchar *name;		/**< Name */
-	gint offs;			/**< Offset */
-	gint type;			/**< Type */
-};
+/** Interned names of the audio route action arguments */
+static GQuark route_arg_quarks[ROUTE_ARG_COUNT];
+
+/** Interned name of the audio route action */
+static GQuark audio_route_action_quark = 0;
+
+/** Interned name of the sink route type */
+static GQuark sink_quark = 0;
+
+/** Lookup table from device name to full audio route + 1 */
+static GHashTable *audio_devices = NULL;
 
 /** Full audio route */
 typedef enum {
@@ -105,29 +118,75 @@ typedef enum {
 	FULL_AUDIO_ROUTE_OTHER = 255
 } full_audio_route_t;
 
+/** Device names used by the policy framework */
+static const struct {
+	const gchar *name;		/**< Device name */
+	full_audio_route_t route;	/**< Full audio route */
+} audio_device_names[] = {
+	{ "null", FULL_AUDIO_ROUTE_NULL },
+	{ "ihf", FULL_AUDIO_ROUTE_IHF },
+	{ "fmtx", FULL_AUDIO_ROUTE_FMTX },
+	{ "ihfandfmtx", FULL_AUDIO_ROUTE_IHF_AND_FMTX },
+	{ "earpiece", FULL_AUDIO_ROUTE_EARPIECE },
+	{ "earpieceandtvout", FULL_AUDIO_ROUTE_EARPIECE_AND_TVOUT },
+	{ "tvout", FULL_AUDIO_ROUTE_TVOUT },
+	{ "ihfandtvout", FULL_AUDIO_ROUTE_IHF_AND_TVOUT },
+	{ "headphone", FULL_AUDIO_ROUTE_HEADPHONE },
+	{ "headset", FULL_AUDIO_ROUTE_HEADSET },
+	{ "bthsp", FULL_AUDIO_ROUTE_BTHSP },
+	{ "bta2dp", FULL_AUDIO_ROUTE_BTA2DP },
+	{ "ihfandheadset", FULL_AUDIO_ROUTE_IHF_AND_HEADSET },
+	{ "ihfandbthsp", FULL_AUDIO_ROUTE_IHF_AND_BTHSP },
+	{ "tvoutandbthsp", FULL_AUDIO_ROUTE_TVOUT_AND_BTHSP },
+	{ "tvoutandbta2dp", FULL_AUDIO_ROUTE_TVOUT_AND_BTA2DP },
+	{ NULL, FULL_AUDIO_ROUTE_UNDEF }
+};
+
+/**
+ * Build the lookup tables used by the parsers
+ */
+static void audio_route_tables_init(void)
+{
+	for (gint i = 0; i < ROUTE_ARG_COUNT; i++)
+		route_arg_quarks[i] =
+			g_quark_from_static_string(route_arg_names[i]);
+
+	audio_route_action_quark =
+		g_quark_from_static_string(POLICY_AUDIO_ROUTE_ACTION);
+	sink_quark = g_quark_from_static_string("sink");
+
+	audio_devices = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (gint i = 0; audio_device_names[i].name != NULL; i++)
+		g_hash_table_insert(audio_devices,
+				    (gpointer)audio_device_names[i].name,
+				    GINT_TO_POINTER(audio_device_names[i].route + 1));
+}
+
 /**
- * Parser used to parse the action information
+ * Parser used to parse the arguments of an audio route action;
+ * argument names are matched by their interned names,
+ * and arguments that aren't used are skipped
  *
  * @param actit Iterator for the action data
- * @param descs A struct with the argument descriptors
- * @param args The arguments to parse
- * @param len The size of args
+ * @param args The arguments, indexed by route_arg_t
  * @return TRUE on success, FALSE on failure
  */
-static gboolean action_parser(DBusMessageIter *actit, struct argdsc *descs,
-			      void *args, guint len)
+static gboolean action_parser(DBusMessageIter *actit,
+			      const gchar *args[ROUTE_ARG_COUNT])
 {
 	gboolean status = FALSE;
 	DBusMessageIter cmdit;
 	DBusMessageIter argit;
 	DBusMessageIter valit;
-	struct argdsc *desc;
-	gchar *argname;
-	void *argval;
+	const gchar *argname;
+	GQuark quark;
+	gint i;
 
 	dbus_message_iter_recurse(actit, &cmdit);
 
-	memset(args, 0, len);
+	for (i = 0; i < ROUTE_ARG_COUNT; i++)
+		args[i] = NULL;
 
 	do {
 		if (dbus_message_iter_get_arg_type(&cmdit) != DBUS_TYPE_STRUCT)
@@ -140,6 +199,17 @@ static gboolean action_parser(DBusMessageIter *actit, struct argdsc *descs,
 
 		dbus_message_iter_get_basic(&argit, (void *)&argname);
 
+		/* Names that were never interned can't be ours */
+		if ((quark = g_quark_try_string(argname)) == 0)
+			continue;
+
+		for (i = 0; i < ROUTE_ARG_COUNT; i++)
+			if (route_arg_quarks[i] == quark)
+				break;
+
+		if (i == ROUTE_ARG_COUNT)
+			continue;
+
 		if (!dbus_message_iter_next(&argit))
 			goto EXIT;
 
@@ -148,28 +218,10 @@ static gboolean action_parser(DBusMessageIter *actit, struct argdsc *descs,
 
 		dbus_message_iter_recurse(&argit, &valit);
 
-		for (desc = descs; desc->name != NULL; desc++) {
-			if (!strcmp(argname, desc->name)) {
-				if (desc->offs + sizeof (gchar *) > len) {
-					mce_log(LL_ERR,
-						"%s desc offset %d is "
-						"out of range %d",
-						"action_parser()",
-						desc->offs, len);
-					goto EXIT;
-				} else {
-					if (dbus_message_iter_get_arg_type(&valit) != desc->type)
-						goto EXIT;
-
-					argval = (char *)args + desc->offs;
-
-					dbus_message_iter_get_basic(&valit, argval);
-				}
-
-				break;
-			}
-		}
+		if (dbus_message_iter_get_arg_type(&valit) != DBUS_TYPE_STRING)
+			goto EXIT;
 
+		dbus_message_iter_get_basic(&valit, (void *)&args[i]);
 	} while (dbus_message_iter_next(&cmdit));
 
 	status = TRUE;
@@ -186,81 +238,35 @@ EXIT:
  */
 static gboolean audio_route_parser(DBusMessageIter *data)
 {
-	static struct argdsc descs[] = {
-		{
-			"type",
-			STRUCT_OFFSET(struct argrt, type),
-			DBUS_TYPE_STRING
-		}, {
-			"device",
-			STRUCT_OFFSET(struct argrt, device),
-			DBUS_TYPE_STRING
-		}, {
-			"mode",
-			STRUCT_OFFSET(struct argrt, mode),
-			DBUS_TYPE_STRING
-		}, {
-			"hwid",
-			STRUCT_OFFSET(struct argrt, hwid),
-			DBUS_TYPE_STRING
-		}, { NULL, 0, DBUS_TYPE_INVALID }
-	};
-
 	full_audio_route_t full_audio_route = FULL_AUDIO_ROUTE_UNDEF;
 	static audio_route_t old_audio_route = AUDIO_ROUTE_UNDEF;
 	audio_route_t audio_route = AUDIO_ROUTE_UNDEF;
+	audio_output_t old_audio_output = datapipe_get_gint(audio_output_pipe);
+	audio_output_t audio_output = AUDIO_OUTPUT_UNDEF;
 	gboolean status = FALSE;
 	gboolean old_tvout_connected;
-	struct argrt args;
+	const gchar *args[ROUTE_ARG_COUNT];
+	gpointer route;
 
 	do {
 		/* If we fail to parse, abort */
-		if (!action_parser(data, descs, &args, sizeof (args)))
+		if (!action_parser(data, args))
 			goto EXIT;
 
 		/* If we don't get the type or device, abort */
-		if ((args.type == NULL) || (args.device == NULL))
+		if ((args[ROUTE_ARG_TYPE] == NULL) ||
+		    (args[ROUTE_ARG_DEVICE] == NULL))
 			goto EXIT;
 
 		/* If this isn't the sink, we're not interested */
-		if (strcmp(args.type, "sink"))
+		if (g_quark_try_string(args[ROUTE_ARG_TYPE]) != sink_quark)
 			continue;
 
-		if (!strcmp(args.device, "null")) {
-			full_audio_route = FULL_AUDIO_ROUTE_NULL;
-		} else if (!strcmp(args.device, "ihf")) {
-			full_audio_route = FULL_AUDIO_ROUTE_IHF;
-		} else if (!strcmp(args.device, "fmtx")) {
-			full_audio_route = FULL_AUDIO_ROUTE_FMTX;
-		} else if (!strcmp(args.device, "ihfandfmtx")) {
-			full_audio_route = FULL_AUDIO_ROUTE_IHF_AND_FMTX;
-		} else if (!strcmp(args.device, "earpiece")) {
-			full_audio_route = FULL_AUDIO_ROUTE_EARPIECE;
-		} else if (!strcmp(args.device, "earpieceandtvout")) {
-			full_audio_route = FULL_AUDIO_ROUTE_EARPIECE_AND_TVOUT;
-		} else if (!strcmp(args.device, "tvout")) {
-			full_audio_route = FULL_AUDIO_ROUTE_TVOUT;
-		} else if (!strcmp(args.device, "ihfandtvout")) {
-			full_audio_route = FULL_AUDIO_ROUTE_IHF_AND_TVOUT;
-		} else if (!strcmp(args.device, "headphone")) {
-			full_audio_route = FULL_AUDIO_ROUTE_HEADPHONE;
-		} else if (!strcmp(args.device, "headset")) {
-			full_audio_route = FULL_AUDIO_ROUTE_HEADSET;
-		} else if (!strcmp(args.device, "bthsp")) {
-			full_audio_route = FULL_AUDIO_ROUTE_BTHSP;
-		} else if (!strcmp(args.device, "bta2dp")) {
-			full_audio_route = FULL_AUDIO_ROUTE_BTA2DP;
-		} else if (!strcmp(args.device, "ihfandheadset")) {
-			full_audio_route = FULL_AUDIO_ROUTE_IHF_AND_HEADSET;
-		} else if (!strcmp(args.device, "ihfandbthsp")) {
-			full_audio_route = FULL_AUDIO_ROUTE_IHF_AND_BTHSP;
-		} else if (!strcmp(args.device, "tvoutandbthsp")) {
-			full_audio_route = FULL_AUDIO_ROUTE_TVOUT_AND_BTHSP;
-		} else if (!strcmp(args.device, "tvoutandbta2dp")) {
-			full_audio_route = FULL_AUDIO_ROUTE_TVOUT_AND_BTA2DP;
-		} else {
-			full_audio_route = FULL_AUDIO_ROUTE_OTHER;
-		}
+		route = g_hash_table_lookup(audio_devices,
+					    args[ROUTE_ARG_DEVICE]);
+		full_audio_route = (route != NULL) ?
+				   GPOINTER_TO_INT(route) - 1 :
+				   FULL_AUDIO_ROUTE_OTHER;
 	} while (dbus_message_iter_next(data));
 
 EXIT:
@@ -326,6 +332,50 @@ EXIT:
 		old_audio_route = audio_route;
 	}
 	
+	/* Class of the device the audio is played through */
+	switch (full_audio_route) {
+	case FULL_AUDIO_ROUTE_EARPIECE:
+	case FULL_AUDIO_ROUTE_EARPIECE_AND_TVOUT:
+		audio_output = AUDIO_OUTPUT_EARPIECE;
+		break;
+
+	case FULL_AUDIO_ROUTE_IHF:
+	case FULL_AUDIO_ROUTE_IHF_AND_FMTX:
+	case FULL_AUDIO_ROUTE_IHF_AND_TVOUT:
+	case FULL_AUDIO_ROUTE_IHF_AND_HEADSET:
+	case FULL_AUDIO_ROUTE_IHF_AND_BTHSP:
+		audio_output = AUDIO_OUTPUT_SPEAKER;
+		break;
+
+	case FULL_AUDIO_ROUTE_HEADPHONE:
+	case FULL_AUDIO_ROUTE_HEADSET:
+		audio_output = AUDIO_OUTPUT_WIRED;
+		break;
+
+	case FULL_AUDIO_ROUTE_BTHSP:
+	case FULL_AUDIO_ROUTE_BTA2DP:
+	case FULL_AUDIO_ROUTE_TVOUT_AND_BTHSP:
+	case FULL_AUDIO_ROUTE_TVOUT_AND_BTA2DP:
+		audio_output = AUDIO_OUTPUT_BLUETOOTH;
+		break;
+
+	/* Like the audio route, keep the old output for NULL routes */
+	case FULL_AUDIO_ROUTE_NULL:
+	case FULL_AUDIO_ROUTE_UNDEF:
+		audio_output = old_audio_output;
+		break;
+
+	default:
+		audio_output = AUDIO_OUTPUT_OTHER;
+		break;
+	}
+
+	if (audio_output != old_audio_output) {
+		execute_datapipe(&audio_output_pipe,
+				 GINT_TO_POINTER(audio_output),
+				 USE_INDATA, CACHE_INDATA);
+	}
+
 	if (tvout_connected != old_tvout_connected ) {
 		execute_datapipe(&tvout_pipe,
 				 GINT_TO_POINTER(tvout_connected),
@@ -385,6 +435,10 @@ static gboolean actions_dbus_cb(DBusMessage *msg)
 
 			dbus_message_iter_get_basic(&entit, (void *)&actname);
 
+			/* Skip actions we don't handle without decoding them */
+			if (g_quark_try_string(actname) != audio_route_action_quark)
+				continue;
+
 			if (!dbus_message_iter_next(&entit) ||
 			    dbus_message_iter_get_arg_type(&entit) != DBUS_TYPE_ARRAY)
 				continue;
@@ -394,9 +448,8 @@ static gboolean actions_dbus_cb(DBusMessage *msg)
 			if (dbus_message_iter_get_arg_type(&actit) != DBUS_TYPE_ARRAY)
 				continue;
 
-			if (!strcmp("com.nokia.policy.audio_route", actname))
-				if (audio_route_parser(&actit) == TRUE)
-					break;
+			if (audio_route_parser(&actit) == TRUE)
+				break;
 		} while (dbus_message_iter_next(&entit));
 	} while (dbus_message_iter_next(&arrit));
 
@@ -419,6 +472,8 @@ const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	audio_route_tables_init();
+
 	/* actions */
 	if (mce_dbus_handler_add(POLICY_DBUS_INTERFACE,
 				 POLICY_AUDIO_ACTIONS,
@@ -443,5 +498,10 @@ void g_module_unload(GModule *module)
 {
 	(void)module;
 
+	if (audio_devices != NULL) {
+		g_hash_table_destroy(audio_devices);
+		audio_devices = NULL;
+	}
+
 	return;
 }
@@ -31,6 +31,9 @@
 /** Unlock the tklock if the camera is popped out? */
 static gboolean popout_unlock = DEFAULT_CAMERA_POPOUT_UNLOCK;
 
+/** Unblank the display when the camera key is pressed? */
+static gboolean camera_key_unblank = DEFAULT_CAMERA_KEY_UNBLANK;
+
 /** Module name */
 #define MODULE_NAME		"camera"
 
@@ -114,11 +117,65 @@ EXIT:
 	return;
 }
 
+/**
+ * Handle camera key state change
+ *
+ * @param data The camera button state stored in a pointer
+ */
+static void camera_button_trigger(gconstpointer data)
+{
+	camera_button_state_t camera_button = GPOINTER_TO_INT(data);
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	cover_state_t proximity_sensor_state =
+				datapipe_get_gint(proximity_sensor_pipe);
+
+	/* Light the display at once, without waiting for the camera
+	 * application to start and request it;
+	 * a key pressed in a pocket should not light the display
+	 */
+	if ((camera_button == CAMERA_BUTTON_LAUNCH) &&
+	    (camera_key_unblank == TRUE) &&
+	    (proximity_sensor_state != COVER_CLOSED) &&
+	    (display_state != MCE_DISPLAY_ON)) {
+		(void)execute_datapipe(&display_state_pipe,
+				       GINT_TO_POINTER(MCE_DISPLAY_ON),
+				       USE_INDATA, CACHE_INDATA);
+	}
+}
+
+/**
+ * Handle lens cover state change
+ *
+ * Once an input device reports the lens cover, the lens cover
+ * is handled through the datapipe and the sysfs pop-out fallback
+ * is no longer needed; input devices can be probed after the
+ * modules are loaded, so this cannot be decided at init
+ *
+ * @param data The lens cover state stored in a pointer
+ */
+static void lens_cover_trigger(gconstpointer data)
+{
+	cover_state_t lens_cover_state = GPOINTER_TO_INT(data);
+
+	if ((lens_cover_state == COVER_UNDEF) ||
+	    (camera_popout_state_iomon_id == NULL))
+		goto EXIT;
+
+	mce_unregister_io_monitor(camera_popout_state_iomon_id);
+	camera_popout_state_iomon_id = NULL;
+
+EXIT:
+	return;
+}
+
 static void handle_device_error_cb(gpointer data, const gchar *device, gconstpointer iomon_id, GError *error) {
     (void)data;
     (void)device;
     (void)error;
 
+    if (iomon_id == camera_popout_state_iomon_id)
+        camera_popout_state_iomon_id = NULL;
+
     mce_unregister_io_monitor(iomon_id);
 }
 
@@ -140,6 +197,16 @@ const gchar *g_module_check_init(GModule *module)
 					  MCE_CONF_CAMERA_POPOUT_UNLOCK,
 					  DEFAULT_CAMERA_POPOUT_UNLOCK,
 					  NULL);
+	camera_key_unblank = mce_conf_get_bool(MCE_CONF_TKLOCK_GROUP,
+					       MCE_CONF_CAMERA_KEY_UNBLANK,
+					       DEFAULT_CAMERA_KEY_UNBLANK,
+					       NULL);
+
+	/* Append triggers/filters to datapipes */
+	append_output_trigger_to_datapipe(&camera_button_pipe,
+					  camera_button_trigger);
+	append_output_trigger_to_datapipe(&lens_cover_pipe,
+					  lens_cover_trigger);
 
 	/* Register I/O monitors */
 	// FIXME: error handling?
@@ -149,11 +216,16 @@ const gchar *g_module_check_init(GModule *module)
 					       TRUE, camera_active_state_cb,
 					       handle_device_error_cb, NULL);
 
-	camera_popout_state_iomon_id =
-		mce_register_io_monitor_string(-1, CAMERA_POPOUT_STATE_PATH,
-					       MCE_IO_ERROR_POLICY_IGNORE,
-					       TRUE, camera_popout_state_cb,
-					       handle_device_error_cb, NULL);
+	/* The lens cover is handled through the lens cover datapipe
+	 * if an input device reports it; the sysfs file is a fallback
+	 * until then, see lens_cover_trigger()
+	 */
+	if (datapipe_get_gint(lens_cover_pipe) == COVER_UNDEF)
+		camera_popout_state_iomon_id =
+			mce_register_io_monitor_string(-1, CAMERA_POPOUT_STATE_PATH,
+						       MCE_IO_ERROR_POLICY_IGNORE,
+						       TRUE, camera_popout_state_cb,
+						       handle_device_error_cb, NULL);
 
 //EXIT:
 	return NULL;
@@ -169,8 +241,15 @@ void g_module_unload(GModule *module)
 {
 	(void)module;
 
+	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&lens_cover_pipe,
+					    lens_cover_trigger);
+	remove_output_trigger_from_datapipe(&camera_button_pipe,
+					    camera_button_trigger);
+
 	/* Unregister I/O monitors */
-	mce_unregister_io_monitor(camera_popout_state_iomon_id);
+	if (camera_popout_state_iomon_id != NULL)
+		mce_unregister_io_monitor(camera_popout_state_iomon_id);
 	mce_unregister_io_monitor(camera_active_state_iomon_id);
 
 	return;
@@ -47,4 +47,10 @@
 /** Default fallback setting for the touchscreen/keypad autolock */
 #define DEFAULT_CAMERA_POPOUT_UNLOCK			TRUE		/* FALSE / TRUE */
 
+/** Name of configuration key for unblanking on camera key press */
+#define MCE_CONF_CAMERA_KEY_UNBLANK			"CameraKeyUnblank"
+
+/** Default fallback setting for unblanking on camera key press */
+#define DEFAULT_CAMERA_KEY_UNBLANK			TRUE		/* FALSE / TRUE */
+
 #endif /* _CAMERA_H_ */
@@ -0,0 +1,458 @@
+/* This module parks CPU cores by taking them offline while the display
+ * is dimmed or off, and brings them back online as soon as it lights up.
+ * The CPUs to keep online are configured per display state; offlining
+ * is delayed so that short blank periods don't cause hotplug cycles.
+ */
+#include <glib.h>
+#include <gmodule.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-conf.h"
+#include "datapipe.h"
+
+/** Module name */
+#define MODULE_NAME		"cpu-parking"
+
+/** Name of the configuration group for this module */
+#define MCE_CONF_CPU_PARKING_GROUP	"CpuParking"
+
+/** Configuration key for the CPU sysfs directory */
+#define MCE_CONF_CPU_PARKING_PATH	"SysfsPath"
+
+/** Configuration key for the CPUs online while the display is on */
+#define MCE_CONF_CPU_PARKING_ON		"OnlineOn"
+
+/** Configuration key for the CPUs online while the display is dimmed */
+#define MCE_CONF_CPU_PARKING_DIM	"OnlineDim"
+
+/** Configuration key for the CPUs online while the display is off */
+#define MCE_CONF_CPU_PARKING_OFF	"OnlineOff"
+
+/** Configuration key for the delay before parking CPUs */
+#define MCE_CONF_CPU_PARKING_DELAY	"ParkDelay"
+
+/** Deprecated quirks-mapphone group, see cpu_parking_read_legacy_config() */
+#define MCE_CONF_MAPPHONE_GROUP		"QuirksMapphone"
+
+/** Deprecated quirks-mapphone key for parking cpu1 while the display is off */
+#define MCE_CONF_MAPPHONE_OFFLINE_CPU	"OfflineCpu"
+
+/** Default CPU sysfs directory */
+#define DEFAULT_CPU_SYSFS_PATH		"/sys/devices/system/cpu"
+
+/** Default delay in milliseconds before parking CPUs */
+#define DEFAULT_PARK_DELAY		5000
+
+/** Largest number of CPUs handled */
+#define MAX_CPUS			64
+
+/** Functionality provided by this module */
+static const gchar *const provides[] = { MODULE_NAME, NULL };
+
+/** Module information */
+G_MODULE_EXPORT module_info_struct module_info = {
+	/** Name of the module */
+	.name = MODULE_NAME,
+	/** Module provides */
+	.provides = provides,
+	/** Module priority */
+	.priority = 250
+};
+
+/** A hotpluggable CPU */
+typedef struct {
+	/** Open fd of the online control, -1 if the CPU can't be hotplugged */
+	int fd;
+	/** Is the CPU online? */
+	bool online;
+} cpu_t;
+
+static cpu_t cpus[MAX_CPUS];
+static guint cpu_count = 0;
+
+/** CPUs to keep online while the display is on, dimmed and off */
+static guint64 online_on = 0;
+static guint64 online_dim = 0;
+static guint64 online_off = 0;
+
+/** Delay in milliseconds before parking CPUs */
+static gint park_delay = DEFAULT_PARK_DELAY;
+
+/** Timeout for parking CPUs */
+static guint park_timeout_cb_id = 0;
+
+/**
+ * Parse a kernel style CPU list, for example "0-1,3"
+ *
+ * @param list The CPU list; NULL for all CPUs
+ * @return The CPU mask; all CPUs if the list is malformed
+ */
+static guint64 cpu_list_to_mask(const gchar *list)
+{
+	guint64 all = (cpu_count >= 64) ? G_MAXUINT64 :
+		      (G_GUINT64_CONSTANT(1) << cpu_count) - 1;
+	guint64 mask = 0;
+	gchar **ranges;
+
+	if (list == NULL)
+		return all;
+
+	ranges = g_strsplit(list, ",", -1);
+
+	for (int i = 0; ranges[i] != NULL; i++) {
+		gchar *range = g_strstrip(ranges[i]);
+		gchar *end = NULL;
+		gulong first = strtoul(range, &end, 10);
+		gulong last = first;
+
+		if (end == range || !g_ascii_isdigit(*range))
+			goto MALFORMED;
+
+		if (*end == '-') {
+			gchar *start = end + 1;
+
+			last = strtoul(start, &end, 10);
+
+			if (end == start || !g_ascii_isdigit(*start))
+				goto MALFORMED;
+		}
+
+		if (*end != '\0' || last < first || last >= MAX_CPUS)
+			goto MALFORMED;
+
+		for (gulong cpu = first; cpu <= last; cpu++)
+			mask |= G_GUINT64_CONSTANT(1) << cpu;
+	}
+
+	g_strfreev(ranges);
+
+	/* The boot CPU always stays online */
+	return (mask | 1) & all;
+
+MALFORMED:
+	mce_log(LL_ERR, "%s: malformed cpu list `%s'; keeping all cpus online",
+		MODULE_NAME, list);
+	g_strfreev(ranges);
+
+	return all;
+}
+
+/**
+ * Read whether a CPU is online, updating the cached state;
+ * the CPU may have been hotplugged by someone else
+ *
+ * @param cpu The CPU number
+ * @return true if the CPU is online, false otherwise
+ */
+static bool cpu_read_online(guint cpu)
+{
+	char state;
+
+	if (cpus[cpu].fd != -1 && pread(cpus[cpu].fd, &state, 1, 0) == 1)
+		cpus[cpu].online = (state == '1');
+
+	errno = 0;
+
+	return cpus[cpu].online;
+}
+
+/**
+ * Bring a CPU online or take it offline
+ *
+ * @param cpu The CPU number
+ * @param online true to bring the CPU online, false to take it offline
+ */
+static void cpu_set_online(guint cpu, bool online)
+{
+	if (cpus[cpu].fd == -1 || cpu_read_online(cpu) == online)
+		return;
+
+	mce_log(LL_DEBUG, "%s: turning %s cpu%u", MODULE_NAME,
+		online ? "on" : "off", cpu);
+
+	if (pwrite(cpus[cpu].fd, online ? "1" : "0", 1, 0) != 1) {
+		mce_log(LL_WARN, "%s: can not turn %s cpu%u; %s",
+			MODULE_NAME, online ? "on" : "off", cpu,
+			g_strerror(errno));
+		errno = 0;
+		return;
+	}
+
+	cpus[cpu].online = online;
+}
+
+/**
+ * Get the CPUs to keep online in the current display state
+ *
+ * @return The CPU mask
+ */
+static guint64 cpu_parking_target(void)
+{
+	switch (datapipe_get_gint(display_state_pipe)) {
+	case MCE_DISPLAY_OFF:
+		return online_off;
+
+	case MCE_DISPLAY_DIM:
+		return online_dim;
+
+	case MCE_DISPLAY_ON:
+	default:
+		return online_on;
+	}
+}
+
+/**
+ * Timeout callback for parking CPUs
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean park_timeout_cb(gpointer data)
+{
+	guint64 target = cpu_parking_target();
+
+	(void)data;
+
+	park_timeout_cb_id = 0;
+
+	/* Park the highest CPUs first */
+	for (guint cpu = cpu_count; cpu-- > 1; ) {
+		if ((target & (G_GUINT64_CONSTANT(1) << cpu)) == 0)
+			cpu_set_online(cpu, false);
+	}
+
+	return FALSE;
+}
+
+/**
+ * Apply the CPU mask of the current display state; CPUs are brought
+ * online at once, while parking waits for the state to settle
+ */
+static void cpu_parking_apply(void)
+{
+	guint64 target = cpu_parking_target();
+	bool park = false;
+
+	if (park_timeout_cb_id != 0) {
+		g_source_remove(park_timeout_cb_id);
+		park_timeout_cb_id = 0;
+	}
+
+	for (guint cpu = 1; cpu < cpu_count; cpu++) {
+		if ((target & (G_GUINT64_CONSTANT(1) << cpu)) != 0)
+			cpu_set_online(cpu, true);
+		else if (cpu_read_online(cpu) == true)
+			park = true;
+	}
+
+	if (park == true)
+		park_timeout_cb_id = g_timeout_add(park_delay,
+						   park_timeout_cb, NULL);
+}
+
+/**
+ * Handle display state change
+ *
+ * @param data Unused
+ */
+static void display_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	cpu_parking_apply();
+}
+
+/**
+ * Find the CPUs and open their online controls
+ *
+ * @param path The CPU sysfs directory
+ */
+static void cpu_parking_open(const gchar *path)
+{
+	for (cpu_count = 0; cpu_count < MAX_CPUS; cpu_count++) {
+		gchar *file = g_strdup_printf("%s/cpu%u/online", path, cpu_count);
+		gchar *dir = g_strdup_printf("%s/cpu%u", path, cpu_count);
+		cpu_t *cpu = &cpus[cpu_count];
+
+		if (g_file_test(dir, G_FILE_TEST_IS_DIR) == FALSE) {
+			g_free(file);
+			g_free(dir);
+			break;
+		}
+
+		/* The boot CPU, and CPUs without an online control,
+		 * are never hotplugged
+		 */
+		cpu->fd = (cpu_count == 0) ? -1 : open(file, O_RDWR);
+		cpu->online = true;
+		(void)cpu_read_online(cpu_count);
+
+		g_free(file);
+		g_free(dir);
+	}
+
+	mce_log(LL_DEBUG, "%s: found %u cpus", MODULE_NAME, cpu_count);
+}
+
+/**
+ * Read the CPU mask of a display state
+ *
+ * @param key The configuration key
+ * @return The CPU mask
+ */
+static guint64 cpu_parking_get_mask(const gchar *key)
+{
+	gchar *list = mce_conf_get_string(MCE_CONF_CPU_PARKING_GROUP,
+					  key, NULL, NULL);
+	guint64 mask = cpu_list_to_mask(list);
+
+	g_free(list);
+
+	return mask;
+}
+
+/**
+ * Apply the deprecated [QuirksMapphone] OfflineCpu key
+ *
+ * quirks-mapphone used to take cpu1 offline whenever the display
+ * was not on, unless OfflineCpu was false; OfflineCpu=false still
+ * keeps cpu1 online, and OfflineCpu=true parks it unless
+ * OnlineDim or OnlineOff is configured
+ */
+static void cpu_parking_read_legacy_config(void)
+{
+	guint64 cpu1 = G_GUINT64_CONSTANT(1) << 1;
+	gchar *value = mce_conf_get_string(MCE_CONF_MAPPHONE_GROUP,
+					   MCE_CONF_MAPPHONE_OFFLINE_CPU,
+					   NULL, NULL);
+	gchar *dim = NULL;
+	gchar *off = NULL;
+
+	if (value == NULL)
+		goto EXIT;
+
+	mce_log(LL_WARN, "%s: [%s] %s is deprecated; "
+		"use [%s] %s and %s instead", MODULE_NAME,
+		MCE_CONF_MAPPHONE_GROUP, MCE_CONF_MAPPHONE_OFFLINE_CPU,
+		MCE_CONF_CPU_PARKING_GROUP, MCE_CONF_CPU_PARKING_DIM,
+		MCE_CONF_CPU_PARKING_OFF);
+
+	if (mce_conf_get_bool(MCE_CONF_MAPPHONE_GROUP,
+			      MCE_CONF_MAPPHONE_OFFLINE_CPU,
+			      TRUE, NULL) == FALSE) {
+		online_on |= cpu1;
+		online_dim |= cpu1;
+		online_off |= cpu1;
+		goto EXIT;
+	}
+
+	dim = mce_conf_get_string(MCE_CONF_CPU_PARKING_GROUP,
+				  MCE_CONF_CPU_PARKING_DIM, NULL, NULL);
+	off = mce_conf_get_string(MCE_CONF_CPU_PARKING_GROUP,
+				  MCE_CONF_CPU_PARKING_OFF, NULL, NULL);
+
+	if (dim == NULL && off == NULL) {
+		online_dim &= ~cpu1;
+		online_off &= ~cpu1;
+	}
+
+EXIT:
+	g_free(off);
+	g_free(dim);
+	g_free(value);
+}
+
+/**
+ * Read the CPU masks and the parking delay
+ */
+static void cpu_parking_read_config(void)
+{
+	online_on = cpu_parking_get_mask(MCE_CONF_CPU_PARKING_ON);
+	online_dim = cpu_parking_get_mask(MCE_CONF_CPU_PARKING_DIM);
+	online_off = cpu_parking_get_mask(MCE_CONF_CPU_PARKING_OFF);
+	cpu_parking_read_legacy_config();
+	park_delay = mce_conf_get_int(MCE_CONF_CPU_PARKING_GROUP,
+				      MCE_CONF_CPU_PARKING_DELAY,
+				      DEFAULT_PARK_DELAY, NULL);
+}
+
+/**
+ * Log the CPU states, for diagnostics
+ */
+G_MODULE_EXPORT void mce_module_dump(void);
+void mce_module_dump(void)
+{
+	guint64 online = 0;
+
+	for (guint cpu = 0; cpu < cpu_count; cpu++) {
+		if (cpus[cpu].online == true)
+			online |= G_GUINT64_CONSTANT(1) << cpu;
+	}
+
+	mce_log(LL_DUMP, "  %u cpus, online %#" G_GINT64_MODIFIER "x, "
+		"target %#" G_GINT64_MODIFIER "x; park timer %u",
+		cpu_count, online, cpu_parking_target(), park_timeout_cb_id);
+}
+
+/**
+ * Re-read the configuration and apply it
+ */
+G_MODULE_EXPORT void mce_module_reload(void);
+void mce_module_reload(void)
+{
+	cpu_parking_read_config();
+	cpu_parking_apply();
+}
+
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
+const gchar *g_module_check_init(GModule *module)
+{
+	gchar *path;
+
+	(void)module;
+
+	path = mce_conf_get_string(MCE_CONF_CPU_PARKING_GROUP,
+				   MCE_CONF_CPU_PARKING_PATH,
+				   DEFAULT_CPU_SYSFS_PATH, NULL);
+	cpu_parking_open(path);
+	g_free(path);
+
+	cpu_parking_read_config();
+
+	/* Append triggers/filters to datapipes */
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  display_state_trigger);
+
+	cpu_parking_apply();
+
+	return NULL;
+}
+
+G_MODULE_EXPORT void g_module_unload(GModule *module);
+void g_module_unload(GModule *module)
+{
+	(void)module;
+
+	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    display_state_trigger);
+
+	if (park_timeout_cb_id != 0) {
+		g_source_remove(park_timeout_cb_id);
+		park_timeout_cb_id = 0;
+	}
+
+	/* Leave every CPU online */
+	for (guint cpu = 1; cpu < cpu_count; cpu++) {
+		cpu_set_online(cpu, true);
+
+		if (cpus[cpu].fd != -1)
+			close(cpus[cpu].fd);
+	}
+}
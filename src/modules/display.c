@@ -29,8 +29,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <glob.h>
 #include <linux/fb.h>
+#include <linux/netlink.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <mce/mode-names.h>
 #include "mce.h"
 #include "display.h"
@@ -93,7 +97,316 @@ static gboolean hw_display_fading = FALSE;
 
 static gboolean is_tvout_state_changed = FALSE;
 
+/** An external display output */
+typedef struct {
+	/** DRM connector name, such as HDMI-A-1 */
+	gchar *name;
+	/** Path to the SysFS connection status */
+	gchar *status_file;
+	/** Is a display connected? */
+	gboolean connected;
+	/** Has the output been switched off on request? */
+	gboolean off_requested;
+	/** Has the connector been forced off through SysFS? */
+	gboolean forced_off;
+	/** Current state of the output */
+	display_state_t state;
+	/** Seen during the latest scan? */
+	gboolean present;
+} display_output_t;
+
+/** List of display_output_t */
+static GSList *display_outputs = NULL;
+
+/** Track external display outputs? */
+static gboolean external_outputs_enabled = DEFAULT_EXTERNAL_OUTPUTS;
+
+/** Kernel uevent socket for DRM hotplug events; -1 if not open */
+static gint output_uevent_fd = -1;
+
+/** Kernel uevent I/O watch ID */
+static guint output_uevent_watch_id = 0;
+
+/** Lid close reconciliation idle callback ID */
+static guint lid_cover_reconcile_cb_id = 0;
+
+/** Did the lid close fast path suspend touch? */
+static gboolean lid_touch_suspended = FALSE;
+
+/** Panel power mode attribute */
+typedef struct {
+	/** Name of the SysFS attribute */
+	const gchar *const name;
+	/** Value that enters the low power mode */
+	const gchar *const enter;
+	/** Value that leaves the low power mode */
+	const gchar *const leave;
+	/**
+	 * Only enter the low power mode once the dim fade has finished;
+	 * used by panels that cannot change brightness in low power mode
+	 */
+	const gboolean after_fade;
+} panel_mode_attr_t;
+
+/** Known panel power mode attributes, in order of preference */
+static const panel_mode_attr_t panel_mode_attrs[] = {
+	{ "lpm", "1", "0", TRUE },
+	{ "idle_mode", "1", "0", FALSE },
+	{ "panel_power_mode", "1", "0", TRUE },
+	{ NULL, NULL, NULL, FALSE }
+};
+
+/** A panel with a discovered power mode attribute */
+typedef struct {
+	/** Path to the attribute */
+	gchar *path;
+	/** The attribute */
+	const panel_mode_attr_t *attr;
+	/** Is the panel currently in low power mode? */
+	gboolean low_power;
+} panel_mode_t;
+
+/** List of panel_mode_t */
+static GSList *panel_modes = NULL;
+
+/** Should the panels be in low power mode? */
+static gboolean panel_mode_wanted = FALSE;
+
+/** Progress of the latest display state change */
+typedef struct {
+	/** Sequence number of the change */
+	guint32 seq;
+	/** Requested display state */
+	display_state_t requested;
+	/** Display state achieved so far */
+	display_state_t achieved;
+	/** Time the change was requested */
+	gint64 request_time;
+	/** Time of the first backlight write */
+	gint64 write_time;
+	/** Time the brightness fade completed */
+	gint64 fade_done_time;
+	/** TRUE until the change has been completed */
+	gboolean pending;
+} display_transition_t;
+
+/** The latest display state change */
+static display_transition_t display_transition = {
+	.seq = 0,
+	.requested = MCE_DISPLAY_UNDEF,
+	.achieved = MCE_DISPLAY_UNDEF,
+	.request_time = 0,
+	.write_time = 0,
+	.fade_done_time = 0,
+	.pending = FALSE
+};
+
 static gboolean display_brightness_dbus_signal(void);
+static gboolean send_display_transition(void);
+
+/**
+ * Write the display brightness,
+ * recording the first write of a pending display state change
+ *
+ * @param brightness The brightness to write
+ */
+static void display_write_brightness(gint brightness)
+{
+	mce_write_number_string_to_file(brightness_file, brightness);
+
+	if ((display_transition.pending == TRUE) &&
+	    (display_transition.write_time == 0))
+		display_transition.write_time = g_get_monotonic_time();
+}
+
+/**
+ * Start tracking a display state change
+ *
+ * @param old_state The display state before the change
+ * @param new_state The requested display state
+ */
+static void display_transition_begin(display_state_t old_state,
+				      display_state_t new_state)
+{
+	display_transition.seq++;
+	display_transition.requested = new_state;
+	display_transition.achieved = old_state;
+	display_transition.request_time = g_get_monotonic_time();
+	display_transition.write_time = 0;
+	display_transition.fade_done_time = 0;
+	display_transition.pending = TRUE;
+}
+
+/**
+ * Report the progress of the pending display state change;
+ * the change is complete once no brightness fade is in progress
+ */
+static void display_transition_update(void)
+{
+	if (display_transition.pending == FALSE)
+		goto EXIT;
+
+	if (brightness_fade_timeout_cb_id == 0) {
+		display_transition.fade_done_time = g_get_monotonic_time();
+		display_transition.achieved = display_transition.requested;
+		display_transition.pending = FALSE;
+	}
+
+	send_display_transition();
+
+EXIT:
+	return;
+}
+
+/**
+ * Switch the low power mode of a panel
+ *
+ * @param panel The panel
+ * @param low_power TRUE to enter low power mode, FALSE to leave it
+ */
+static void panel_mode_set(panel_mode_t *panel, gboolean low_power)
+{
+	if (panel->low_power == low_power)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: %s low power mode via %s", MODULE_NAME,
+		low_power ? "entering" : "leaving", panel->path);
+
+	if (mce_write_string_to_file(panel->path,
+				     low_power ? panel->attr->enter :
+						 panel->attr->leave) == TRUE)
+		panel->low_power = low_power;
+
+EXIT:
+	return;
+}
+
+/**
+ * Enter the panel low power mode
+ *
+ * @param fade_done TRUE if the dim fade has finished,
+ *                  FALSE to only switch panels that allow fading
+ *                  in low power mode
+ */
+static void panel_mode_enter(gboolean fade_done)
+{
+	for (GSList *iter = panel_modes; iter; iter = iter->next) {
+		panel_mode_t *panel = iter->data;
+
+		if ((panel->attr->after_fade == FALSE) || (fade_done == TRUE))
+			panel_mode_set(panel, TRUE);
+	}
+}
+
+/**
+ * Leave the panel low power mode
+ */
+static void panel_mode_leave(void)
+{
+	for (GSList *iter = panel_modes; iter; iter = iter->next)
+		panel_mode_set(iter->data, FALSE);
+}
+
+/**
+ * Look for a panel power mode attribute in a directory
+ *
+ * @param dir The directory to look in, with a trailing slash
+ */
+static void panel_mode_probe_dir(const gchar *dir)
+{
+	gchar *canonical = realpath(dir, NULL);
+
+	if (canonical == NULL)
+		goto EXIT;
+
+	/* The same panel can be reachable via several class links */
+	for (GSList *iter = panel_modes; iter; iter = iter->next) {
+		panel_mode_t *panel = iter->data;
+		gchar *panel_dir = g_path_get_dirname(panel->path);
+		gboolean same = (strcmp(panel_dir, canonical) == 0);
+
+		g_free(panel_dir);
+
+		if (same == TRUE)
+			goto EXIT;
+	}
+
+	for (gint i = 0; panel_mode_attrs[i].name != NULL; i++) {
+		gchar *path = g_strconcat(canonical, "/",
+					  panel_mode_attrs[i].name, NULL);
+
+		if (g_access(path, W_OK) == 0) {
+			panel_mode_t *panel = g_new0(panel_mode_t, 1);
+
+			panel->path = path;
+			panel->attr = &panel_mode_attrs[i];
+			panel->low_power = FALSE;
+			panel_modes = g_slist_append(panel_modes, panel);
+
+			mce_log(LL_DEBUG, "%s: using %s as panel power mode",
+				MODULE_NAME, path);
+			break;
+		}
+
+		g_free(path);
+	}
+
+EXIT:
+	free(canonical);
+}
+
+/**
+ * Discover the panel power mode attributes
+ */
+static void panel_mode_init(void)
+{
+	static const gchar *const globs[] = { DISPLAY_PANEL_MODE_GLOBS, NULL };
+
+	/* The panel is usually the parent device of the backlight */
+	if (brightness_file != NULL) {
+		gchar *dir = g_path_get_dirname(brightness_file);
+		gchar *device = g_strconcat(dir, "/device/", NULL);
+
+		panel_mode_probe_dir(device);
+		g_free(device);
+		g_free(dir);
+	}
+
+	for (gint i = 0; globs[i] != NULL; i++) {
+		glob_t glob_result;
+
+		if (glob(globs[i], GLOB_ONLYDIR, NULL, &glob_result) != 0)
+			continue;
+
+		for (size_t j = 0; j < glob_result.gl_pathc; j++)
+			panel_mode_probe_dir(glob_result.gl_pathv[j]);
+
+		globfree(&glob_result);
+	}
+}
+
+/**
+ * Free a discovered panel
+ *
+ * @param data The panel_mode_t to free
+ */
+static void panel_mode_free(gpointer data)
+{
+	panel_mode_t *panel = data;
+
+	g_free(panel->path);
+	g_free(panel);
+}
+
+/**
+ * Leave the panel low power mode and free all discovered panels
+ */
+static void panel_mode_exit(void)
+{
+	panel_mode_leave();
+	g_slist_free_full(panel_modes, panel_mode_free);
+	panel_modes = NULL;
+}
 
 /**
  * Timeout callback for the brightness fade
@@ -119,11 +432,19 @@ static gboolean brightness_fade_timeout_cb(gpointer data)
 		cached_brightness -= brightness_fade_steplength;
 	}
 
-	mce_write_number_string_to_file(brightness_file,
-					cached_brightness);
+	display_write_brightness(cached_brightness);
+
+	if (retval == FALSE) {
+		brightness_fade_timeout_cb_id = 0;
 
-	if (retval == FALSE)
-		 brightness_fade_timeout_cb_id = 0;
+		/* Panels that cannot fade in low power mode
+		 * enter it once the dim fade is done
+		 */
+		if (panel_mode_wanted == TRUE)
+			panel_mode_enter(TRUE);
+
+		display_transition_update();
+	}
 
 	return retval;
 }
@@ -169,8 +490,7 @@ static void update_brightness_fade(gint new_brightness)
 		cancel_brightness_fade_timeout();
 		cached_brightness = new_brightness;
 		target_brightness = new_brightness;
-		mce_write_number_string_to_file(brightness_file,
-						new_brightness);
+		display_write_brightness(new_brightness);
 		goto EXIT;
 	}
 
@@ -195,10 +515,16 @@ EXIT:
  */
 static void display_blank(void)
 {
+	panel_mode_wanted = FALSE;
 	cancel_brightness_fade_timeout();
 	cached_brightness = 0;
 	target_brightness = 0;
-	mce_write_number_string_to_file(brightness_file, 0);
+	display_write_brightness(0);
+
+	/* Leave low power mode while dark,
+	 * so that the panel comes back up in normal mode
+	 */
+	panel_mode_leave();
 }
 
 /**
@@ -206,7 +532,11 @@ static void display_blank(void)
  */
 static void display_dim(void)
 {
+	panel_mode_wanted = TRUE;
 	update_brightness_fade((maximum_display_brightness * dim_brightness) / 100);
+
+	/* Without a fade in progress all panels can switch right away */
+	panel_mode_enter(brightness_fade_timeout_cb_id == 0);
 }
 
 /**
@@ -214,12 +544,15 @@ static void display_dim(void)
  */
 static void display_unblank(void)
 {
+	/* Leave low power mode before the panel is lit up again */
+	panel_mode_wanted = FALSE;
+	panel_mode_leave();
+
 	/* If we unblank, switch on display immediately */
 	if (cached_brightness == 0) {
 		cached_brightness = set_brightness;
 		target_brightness = set_brightness;
-		mce_write_number_string_to_file(brightness_file,
-						set_brightness);
+		display_write_brightness(set_brightness);
 	} else {
 		update_brightness_fade(set_brightness);
 	}
@@ -298,12 +631,32 @@ static void setup_blank_timeout(void)
 {
 	cancel_blank_timeout();
 
+	/* Stay dimmed while blanking is inhibited */
+	if (datapipe_get_gint(blank_inhibit_pipe) != FALSE)
+		return;
+
 	/* Setup new timeout */
 	blank_timeout_cb_id =
 		g_timeout_add_seconds(disp_blank_timeout,
 				      blank_timeout_cb, NULL);
 }
 
+/**
+ * Handle blanking inhibit change
+ *
+ * @param data TRUE if blanking is inhibited, stored in a pointer
+ */
+static void blank_inhibit_trigger(gconstpointer data)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+
+	(void)data;
+
+	/* Re-evaluate the blank timeout of a dimmed display */
+	if (display_state == MCE_DISPLAY_DIM)
+		setup_blank_timeout();
+}
+
 /**
  * rtconf callback for display related settings
  *
@@ -329,20 +682,14 @@ static void display_rtconf_cb(const gchar *key, guint cb_id, void *user_data)
 }
 
 /**
- * Send a display status reply or signal
+ * Get the D-Bus name of a display state
  *
- * @param method_call A DBusMessage to reply to;
- *                    pass NULL to send a display status signal instead
- * @return TRUE on success, FALSE on failure
+ * @param display_state The display state
+ * @return The display state string
  */
-static gboolean send_display_status(DBusMessage *const method_call)
+static const gchar *display_state_to_string(display_state_t display_state)
 {
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	gboolean is_tvout_on = datapipe_get_gint(tvout_pipe);
-
-	DBusMessage *msg = NULL;
 	const gchar *state = NULL;
-	gboolean status = FALSE;
 
 	switch (display_state) {
 	case MCE_DISPLAY_OFF:
@@ -358,6 +705,75 @@ static gboolean send_display_status(DBusMessage *const method_call)
 		state = MCE_DISPLAY_ON_STRING;
 		break;
 	}
+
+	return state;
+}
+
+/**
+ * Send the extended display status signal
+ * for the latest display state change
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean send_display_transition(void)
+{
+	const gchar *requested =
+		display_state_to_string(display_transition.requested);
+	const gchar *achieved =
+		display_state_to_string(display_transition.achieved);
+	dbus_uint32_t seq = display_transition.seq;
+	dbus_int64_t request_time = display_transition.request_time;
+	dbus_int64_t write_time = display_transition.write_time;
+	dbus_int64_t fade_done_time = display_transition.fade_done_time;
+	DBusMessage *msg = NULL;
+	gboolean status = FALSE;
+
+	mce_log(LL_DEBUG,
+		"%s: Display state change %u: %s -> %s; written after "
+		"%" G_GINT64_FORMAT " us", MODULE_NAME, seq, achieved,
+		requested, write_time ? write_time - request_time : 0);
+
+	/* display_status_ext_ind */
+	msg = dbus_new_signal(MCE_SIGNAL_PATH, MCE_SIGNAL_IF,
+			      MCE_DISPLAY_EXT_SIG);
+
+	if (dbus_message_append_args(msg,
+				     DBUS_TYPE_STRING, &requested,
+				     DBUS_TYPE_STRING, &achieved,
+				     DBUS_TYPE_UINT32, &seq,
+				     DBUS_TYPE_INT64, &request_time,
+				     DBUS_TYPE_INT64, &write_time,
+				     DBUS_TYPE_INT64, &fade_done_time,
+				     DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"%s: Failed to append argument to D-Bus message "
+			"for %s.%s", MODULE_NAME,
+			MCE_SIGNAL_IF, MCE_DISPLAY_EXT_SIG);
+		dbus_message_unref(msg);
+		goto EXIT;
+	}
+
+	status = dbus_send_message(msg);
+
+EXIT:
+	return status;
+}
+
+/**
+ * Send a display status reply or signal
+ *
+ * @param method_call A DBusMessage to reply to;
+ *                    pass NULL to send a display status signal instead
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean send_display_status(DBusMessage *const method_call)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	gboolean is_tvout_on = datapipe_get_gint(tvout_pipe);
+
+	DBusMessage *msg = NULL;
+	const gchar *state = display_state_to_string(display_state);
+	gboolean status = FALSE;
 	if ((is_tvout_state_changed == TRUE) && (display_state == MCE_DISPLAY_OFF)) {
 		state = is_tvout_on ? MCE_DISPLAY_ON_STRING : MCE_DISPLAY_OFF_STRING;
 	}
@@ -617,6 +1033,579 @@ static gboolean display_brightness_get_dbus_cb(DBusMessage *const msg)
 	return status;
 }
 
+static void tvout_trigger(gconstpointer data)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	gboolean is_tvout_on = GPOINTER_TO_INT(data);
+	
+	mce_log(LL_DEBUG, "Recieved tvout state changing: is_tvout_on = %d", is_tvout_on);	
+	
+	if (display_state == MCE_DISPLAY_OFF) {
+		is_tvout_state_changed = TRUE;
+		send_display_status(NULL);
+		is_tvout_state_changed = FALSE;
+	}
+	return;
+}
+
+/**
+ * Send an external display output status signal
+ *
+ * @param output The output
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean send_display_output_status(const display_output_t *output)
+{
+	const gchar *state = display_state_to_string(output->state);
+	DBusMessage *msg = NULL;
+	gboolean status = FALSE;
+
+	mce_log(LL_DEBUG, "%s: Sending output %s status: %s",
+		MODULE_NAME, output->name, state);
+
+	/* display_output_status_ind */
+	msg = dbus_new_signal(MCE_SIGNAL_PATH, MCE_SIGNAL_IF,
+			      MCE_DISPLAY_OUTPUT_SIG);
+
+	if (dbus_message_append_args(msg,
+				     DBUS_TYPE_STRING, &output->name,
+				     DBUS_TYPE_STRING, &state,
+				     DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"%s: Failed to append argument to D-Bus message "
+			"for %s.%s", MODULE_NAME,
+			MCE_SIGNAL_IF, MCE_DISPLAY_OUTPUT_SIG);
+		dbus_message_unref(msg);
+		goto EXIT;
+	}
+
+	status = dbus_send_message(msg);
+
+EXIT:
+	return status;
+}
+
+/**
+ * Find an external display output by connector name
+ *
+ * @param name The DRM connector name
+ * @return The output, or NULL if not found
+ */
+static display_output_t *display_output_find(const gchar *name)
+{
+	for (GSList *iter = display_outputs; iter; iter = iter->next) {
+		display_output_t *output = iter->data;
+
+		if (strcmp(output->name, name) == 0)
+			return output;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free an external display output
+ *
+ * @param data The display_output_t to free
+ */
+static void display_output_free(gpointer data)
+{
+	display_output_t *output = data;
+
+	g_free(output->name);
+	g_free(output->status_file);
+	g_free(output);
+}
+
+/**
+ * Read whether a display is connected to an external output;
+ * a new display starts out powered
+ *
+ * @param output The output
+ */
+static void display_output_read_connected(display_output_t *output)
+{
+	gchar *status = NULL;
+	gboolean connected;
+
+	if (mce_read_string_from_file(output->status_file, &status) == FALSE)
+		goto EXIT;
+
+	connected = g_str_has_prefix(status, DISPLAY_DRM_CONNECTOR_CONNECTED);
+
+	if ((connected == TRUE) && (output->connected == FALSE))
+		output->off_requested = FALSE;
+
+	output->connected = connected;
+
+EXIT:
+	g_free(status);
+}
+
+/**
+ * Update the power state of all external display outputs;
+ * an output is on while connected, unless it has been switched off
+ * on request, and independent of the internal panel
+ */
+static void display_outputs_update(void)
+{
+	system_state_t system_state = datapipe_get_gint(system_state_pipe);
+
+	/* Leave the outputs alone until the system state is known */
+	if (system_state == MCE_STATE_UNDEF)
+		return;
+
+	for (GSList *iter = display_outputs; iter; iter = iter->next) {
+		display_output_t *output = iter->data;
+		display_state_t state = MCE_DISPLAY_OFF;
+
+		if ((output->connected == TRUE) &&
+		    (output->off_requested == FALSE) &&
+		    (system_state == MCE_STATE_USER))
+			state = MCE_DISPLAY_ON;
+
+		/* Forcing the connector off makes the kernel report it
+		 * as disconnected, so the display server powers it down
+		 * and lays out the remaining outputs as after an unplug;
+		 * "detect" hands the connector back to hotplug detection
+		 */
+		if ((state == MCE_DISPLAY_OFF) &&
+		    (output->connected == TRUE) &&
+		    (output->forced_off == FALSE)) {
+			output->forced_off =
+				mce_write_string_to_file(output->status_file,
+							 DISPLAY_DRM_CONNECTOR_FORCE_OFF);
+		} else if ((state == MCE_DISPLAY_ON) &&
+			   (output->forced_off == TRUE)) {
+			(void)mce_write_string_to_file(output->status_file,
+						       DISPLAY_DRM_CONNECTOR_DETECT);
+			output->forced_off = FALSE;
+
+			/* The display may have been unplugged meanwhile */
+			display_output_read_connected(output);
+
+			if (output->connected == FALSE)
+				state = MCE_DISPLAY_OFF;
+		}
+
+		if (output->state != state) {
+			output->state = state;
+			send_display_output_status(output);
+		}
+	}
+}
+
+/**
+ * Rescan the DRM connectors for external displays
+ */
+static void display_outputs_scan(void)
+{
+	static const gchar *const internal[] = {
+		DISPLAY_DRM_INTERNAL_CONNECTORS, NULL
+	};
+	glob_t glob_result;
+	GSList *iter;
+	GSList *next;
+
+	for (iter = display_outputs; iter; iter = iter->next)
+		((display_output_t *)iter->data)->present = FALSE;
+
+	if (glob(DISPLAY_DRM_CONNECTOR_STATUS_GLOB, 0,
+		 NULL, &glob_result) != 0)
+		goto UPDATE;
+
+	for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+		const gchar *path = glob_result.gl_pathv[i];
+		gchar *dir = g_path_get_dirname(path);
+		gchar *base = g_path_get_basename(dir);
+		const gchar *name = strchr(base, '-');
+		display_output_t *output;
+		gint j;
+
+		/* card0-HDMI-A-1 -> HDMI-A-1 */
+		if (name == NULL)
+			goto NEXT;
+
+		name++;
+
+		for (j = 0; internal[j] != NULL; j++) {
+			if (g_str_has_prefix(name, internal[j]) == TRUE)
+				break;
+		}
+
+		/* The internal panel follows the display state */
+		if (internal[j] != NULL)
+			goto NEXT;
+
+		if ((output = display_output_find(name)) == NULL) {
+			output = g_new0(display_output_t, 1);
+			output->name = g_strdup(name);
+			output->status_file = g_strdup(path);
+			output->state = MCE_DISPLAY_UNDEF;
+			display_outputs = g_slist_append(display_outputs,
+							 output);
+			mce_log(LL_DEBUG, "%s: found output %s",
+				MODULE_NAME, output->name);
+		}
+
+		output->present = TRUE;
+
+		/* A forced off connector always reads as disconnected;
+		 * it is re-read when handed back to hotplug detection
+		 */
+		if (output->forced_off == FALSE)
+			display_output_read_connected(output);
+
+NEXT:
+		g_free(base);
+		g_free(dir);
+	}
+
+	globfree(&glob_result);
+
+UPDATE:
+	/* Removed connectors are reported as off and forgotten */
+	for (iter = display_outputs; iter; iter = next) {
+		display_output_t *output = iter->data;
+
+		next = iter->next;
+
+		if (output->present == TRUE)
+			continue;
+
+		if (output->state == MCE_DISPLAY_ON) {
+			output->state = MCE_DISPLAY_OFF;
+			send_display_output_status(output);
+		}
+
+		display_outputs = g_slist_delete_link(display_outputs, iter);
+		display_output_free(output);
+	}
+
+	display_outputs_update();
+}
+
+/**
+ * I/O callback for kernel uevents; rescan the DRM connectors
+ * when the DRM subsystem reports a hotplug event
+ *
+ * @param source Unused
+ * @param condition The I/O condition
+ * @param data Unused
+ * @return TRUE to keep the watch, FALSE to remove it
+ */
+static gboolean output_uevent_cb(GIOChannel *source,
+				 GIOCondition condition, gpointer data)
+{
+	gchar buf[4096];
+	gboolean hotplug = FALSE;
+	ssize_t len;
+
+	(void)source;
+	(void)data;
+
+	if ((condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) != 0) {
+		mce_log(LL_ERR, "%s: kernel uevent socket failed; "
+			"external outputs are no longer tracked",
+			MODULE_NAME);
+		output_uevent_watch_id = 0;
+		close(output_uevent_fd);
+		output_uevent_fd = -1;
+		return FALSE;
+	}
+
+	while ((len = recv(output_uevent_fd, buf, sizeof (buf) - 1,
+			   MSG_DONTWAIT)) > 0) {
+		buf[len] = '\0';
+
+		/* The event is a header followed by NUL separated
+		 * KEY=value pairs
+		 */
+		for (ssize_t i = 0; i < len; i += strlen(buf + i) + 1) {
+			if (strcmp(buf + i, "SUBSYSTEM=drm") == 0)
+				hotplug = TRUE;
+		}
+	}
+
+	if (hotplug == TRUE)
+		display_outputs_scan();
+
+	return TRUE;
+}
+
+/**
+ * Start listening to DRM hotplug events and find the connected outputs
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean display_outputs_init(void)
+{
+	struct sockaddr_nl addr;
+	GIOChannel *channel;
+	gboolean status = FALSE;
+
+	output_uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+				  NETLINK_KOBJECT_UEVENT);
+
+	if (output_uevent_fd == -1) {
+		mce_log(LL_ERR, "%s: failed to open kernel uevent socket; %s",
+			MODULE_NAME, g_strerror(errno));
+		goto EXIT;
+	}
+
+	memset(&addr, 0, sizeof (addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* kernel events */
+
+	if (bind(output_uevent_fd, (struct sockaddr *)&addr,
+		 sizeof (addr)) == -1) {
+		mce_log(LL_ERR, "%s: failed to bind kernel uevent socket; %s",
+			MODULE_NAME, g_strerror(errno));
+		close(output_uevent_fd);
+		output_uevent_fd = -1;
+		goto EXIT;
+	}
+
+	channel = g_io_channel_unix_new(output_uevent_fd);
+	output_uevent_watch_id =
+		g_io_add_watch(channel,
+			       G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+			       output_uevent_cb, NULL);
+	g_io_channel_unref(channel);
+
+	display_outputs_scan();
+
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Stop listening to DRM hotplug events and forget the outputs;
+ * connectors that were forced off are handed back to hotplug detection
+ */
+static void display_outputs_exit(void)
+{
+	if (output_uevent_watch_id != 0) {
+		g_source_remove(output_uevent_watch_id);
+		output_uevent_watch_id = 0;
+	}
+
+	if (output_uevent_fd != -1) {
+		close(output_uevent_fd);
+		output_uevent_fd = -1;
+	}
+
+	for (GSList *iter = display_outputs; iter; iter = iter->next) {
+		display_output_t *output = iter->data;
+
+		if (output->forced_off == TRUE)
+			(void)mce_write_string_to_file(output->status_file,
+						       DISPLAY_DRM_CONNECTOR_DETECT);
+	}
+
+	g_slist_free_full(display_outputs, display_output_free);
+	display_outputs = NULL;
+}
+
+/**
+ * Handle system state change
+ *
+ * @param data Unused
+ */
+static void system_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	display_outputs_update();
+}
+
+/**
+ * D-Bus callback for the external display output state method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean display_output_state_req_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	display_output_t *output;
+	const gchar *name = NULL;
+	const gchar *state = NULL;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &name,
+				  DBUS_TYPE_STRING, &state,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"Failed to get argument from %s.%s: %s",
+			MCE_REQUEST_IF, MCE_DISPLAY_OUTPUT_STATE_REQ,
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	mce_log(LL_DEBUG, "%s: Received output %s state request: %s",
+		MODULE_NAME, name, state);
+
+	if ((output = display_output_find(name)) == NULL) {
+		mce_log(LL_WARN, "%s: Unknown output %s", MODULE_NAME, name);
+	} else {
+		output->off_requested =
+			(strcmp(state, MCE_DISPLAY_OFF_STRING) == 0);
+		display_outputs_update();
+	}
+
+	if (no_reply == FALSE) {
+		DBusMessage *reply = dbus_new_method_reply(msg);
+
+		status = dbus_send_message(reply);
+	} else {
+		status = TRUE;
+	}
+
+EXIT:
+	return status;
+}
+
+/**
+ * Undo the lid close fast path where the policy did not follow it:
+ * light the backlight again unless the display is off, and resume
+ * touch unless the lock module has since taken it over
+ */
+static void lid_cover_restore(void)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	submode_t submode = datapipe_get_gint(submode_pipe);
+
+	if (display_state == MCE_DISPLAY_ON)
+		display_unblank();
+	else if (display_state == MCE_DISPLAY_DIM)
+		display_dim();
+
+	if (lid_touch_suspended == FALSE)
+		goto EXIT;
+
+	lid_touch_suspended = FALSE;
+
+	if ((submode & MCE_TKLOCK_SUBMODE) != 0)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: resuming touch", MODULE_NAME);
+	(void)execute_datapipe(&touchscreen_suspend_pipe,
+			       GINT_TO_POINTER(FALSE),
+			       USE_INDATA, CACHE_INDATA);
+
+EXIT:
+	return;
+}
+
+/**
+ * Idle callback reconciling the lid close fast path with the policy;
+ * the lock module owns the display state, so if it chose not to blank
+ * the display, the backlight and touch are restored
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the idle source
+ */
+static gboolean lid_cover_reconcile_cb(gpointer data)
+{
+	cover_state_t lid_cover_state = datapipe_get_gint(lid_cover_pipe);
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	submode_t submode = datapipe_get_gint(submode_pipe);
+
+	(void)data;
+
+	lid_cover_reconcile_cb_id = 0;
+
+	if ((lid_cover_state == COVER_CLOSED) &&
+	    (display_state == MCE_DISPLAY_OFF)) {
+		/* Once locked, the lock module resumes touch on unlock */
+		if ((submode & MCE_TKLOCK_SUBMODE) != 0)
+			lid_touch_suspended = FALSE;
+
+		goto EXIT;
+	}
+
+	mce_log(LL_DEBUG, "%s: lid close not followed by the policy; "
+		"restoring display", MODULE_NAME);
+	lid_cover_restore();
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Cancel the lid close reconciliation
+ */
+static void cancel_lid_cover_reconcile(void)
+{
+	if (lid_cover_reconcile_cb_id != 0) {
+		g_source_remove(lid_cover_reconcile_cb_id);
+		lid_cover_reconcile_cb_id = 0;
+	}
+}
+
+/**
+ * Fast path for lid close
+ *
+ * Runs as an input trigger, before the lock module and display state
+ * handling see the change: the backlight is switched off and touch
+ * is suspended right away, and the lock module decides the display
+ * state; on open, whatever the lock module did not take over is undone
+ *
+ * @param data The lid cover state stored in a pointer
+ */
+static void lid_cover_trigger(gconstpointer data)
+{
+	system_state_t system_state = datapipe_get_gint(system_state_pipe);
+	cover_state_t lid_cover_state = GPOINTER_TO_INT(data);
+	gint64 start;
+
+	/* Opened before the policy was reconciled, or with touch
+	 * still suspended by the fast path
+	 */
+	if (lid_cover_state == COVER_OPEN) {
+		if ((lid_cover_reconcile_cb_id != 0) ||
+		    (lid_touch_suspended == TRUE)) {
+			cancel_lid_cover_reconcile();
+			lid_cover_restore();
+		}
+
+		goto EXIT;
+	}
+
+	if ((lid_cover_state != COVER_CLOSED) ||
+	    (system_state != MCE_STATE_USER))
+		goto EXIT;
+
+	start = g_get_monotonic_time();
+
+	display_blank();
+
+	if (datapipe_get_gint(touchscreen_suspend_pipe) == 0) {
+		lid_touch_suspended = TRUE;
+		(void)execute_datapipe(&touchscreen_suspend_pipe,
+				       GINT_TO_POINTER(TRUE),
+				       USE_INDATA, CACHE_INDATA);
+	}
+
+	mce_log(LL_DEBUG, "%s: lid closed; dark after %" G_GINT64_FORMAT " us",
+		MODULE_NAME, g_get_monotonic_time() - start);
+
+	if (lid_cover_reconcile_cb_id == 0)
+		lid_cover_reconcile_cb_id =
+			g_idle_add(lid_cover_reconcile_cb, NULL);
+
+EXIT:
+	return;
+}
+
 /**
  * Handle display state change
  *
@@ -649,6 +1638,8 @@ static void display_state_trigger(gconstpointer data)
 	if (cached_display_state == display_state)
 		goto EXIT;
 
+	display_transition_begin(cached_display_state, display_state);
+
 	switch (display_state) {
 	case MCE_DISPLAY_OFF:
 		display_blank();
@@ -668,6 +1659,7 @@ static void display_state_trigger(gconstpointer data)
 	 * since the pipe contains the new value
 	 */
 	send_display_status(NULL);
+	display_transition_update();
 
 	/* Update the cached value */
 	cached_display_state = display_state;
@@ -709,21 +1701,6 @@ static void device_inactive_trigger(gconstpointer data)
 	}
 }
 
-static void tvout_trigger(gconstpointer data)
-{
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	gboolean is_tvout_on = GPOINTER_TO_INT(data);
-	
-	mce_log(LL_DEBUG, "Recieved tvout state changing: is_tvout_on = %d", is_tvout_on);	
-	
-	if (display_state == MCE_DISPLAY_OFF) {
-		is_tvout_state_changed = TRUE;
-		send_display_status(NULL);
-		is_tvout_state_changed = FALSE;
-	}
-	return;
-}
-
 /**
  * Get the display type
  *
@@ -765,6 +1742,24 @@ static bool get_display(void)
 	return ret;
 }
 
+/**
+ * Log the brightness state and timers, for diagnostics
+ */
+G_MODULE_EXPORT void mce_module_dump(void);
+void mce_module_dump(void)
+{
+	mce_log(LL_DUMP, "  brightness %d, target %d, cached %d, max %d",
+		set_brightness, target_brightness, cached_brightness,
+		maximum_display_brightness);
+	mce_log(LL_DUMP, "  blank timeout %d s; timers: blank %d, fade %d, "
+		"lid reconcile %u", disp_blank_timeout,
+		blank_timeout_cb_id, brightness_fade_timeout_cb_id,
+		lid_cover_reconcile_cb_id);
+	mce_log(LL_DUMP, "  %u external outputs%s",
+		g_slist_length(display_outputs),
+		(output_uevent_fd != -1) ? ", tracking hotplug" : "");
+}
+
 G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 const gchar *g_module_check_init(GModule *module)
 {
@@ -783,6 +1778,11 @@ const gchar *g_module_check_init(GModule *module)
 
 	dim_brightness = mce_conf_get_int("DisplayBrightness", "Dim", DEFAULT_DIM_BRIGHTNESS, NULL);
 
+	if (mce_conf_get_bool(MCE_CONF_DISPLAY_GROUP,
+			      MCE_CONF_DISPLAY_PANEL_LPM_KEY,
+			      DEFAULT_PANEL_LPM_DIM, NULL) == TRUE)
+		panel_mode_init();
+
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&display_brightness_pipe,
 					  display_brightness_trigger);
@@ -792,6 +1792,22 @@ const gchar *g_module_check_init(GModule *module)
 					  device_inactive_trigger);
 	append_output_trigger_to_datapipe(&tvout_pipe, 
 					  tvout_trigger);
+	append_output_trigger_to_datapipe(&system_state_pipe,
+					  system_state_trigger);
+	append_input_trigger_to_datapipe(&lid_cover_pipe,
+					 lid_cover_trigger);
+	append_output_trigger_to_datapipe(&blank_inhibit_pipe,
+					  blank_inhibit_trigger);
+
+	external_outputs_enabled =
+		mce_conf_get_bool(MCE_CONF_DISPLAY_GROUP,
+				  MCE_CONF_DISPLAY_EXTERNAL_OUTPUTS_KEY,
+				  DEFAULT_EXTERNAL_OUTPUTS,
+				  NULL);
+
+	if (external_outputs_enabled == TRUE)
+		(void)display_outputs_init();
+
 	/* Get maximum brightness */
 	if (mce_read_number_string_from_file(max_brightness_file,
 					     &tmp) == FALSE) {
@@ -884,6 +1900,14 @@ const gchar *g_module_check_init(GModule *module)
 				 display_brightness_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* req_display_output_state */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DISPLAY_OUTPUT_STATE_REQ,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 display_output_state_req_dbus_cb) == NULL)
+		goto EXIT;
+
 	/* Request display on to get the state machine in sync */
 	(void)execute_datapipe(&display_state_pipe,
 			       GINT_TO_POINTER(MCE_DISPLAY_ON),
@@ -899,6 +1923,12 @@ void g_module_unload(GModule *module)
 	(void)module;
 
 	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&blank_inhibit_pipe,
+					    blank_inhibit_trigger);
+	remove_input_trigger_from_datapipe(&lid_cover_pipe,
+					   lid_cover_trigger);
+	remove_output_trigger_from_datapipe(&system_state_pipe,
+					    system_state_trigger);
 	remove_output_trigger_from_datapipe(&tvout_pipe, 
 					  tvout_trigger);
 	remove_output_trigger_from_datapipe(&device_inactive_pipe,
@@ -908,13 +1938,18 @@ void g_module_unload(GModule *module)
 	remove_output_trigger_from_datapipe(&display_brightness_pipe,
 					    display_brightness_trigger);
 
-	/* Free strings */
-	g_free(brightness_file);
-	g_free(max_brightness_file);
-
 	/* Remove all timer sources */
 	cancel_brightness_fade_timeout();
 	cancel_blank_timeout();
+	cancel_lid_cover_reconcile();
+
+	panel_mode_exit();
+
+	display_outputs_exit();
+
+	/* Free strings */
+	g_free(brightness_file);
+	g_free(max_brightness_file);
 
 	return;
 }
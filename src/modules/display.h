@@ -31,6 +31,8 @@
 
 #define MCE_CONF_DISPLAY_GROUP "Display"
 #define MCE_CONF_DISPLAY_BLANK_KEY "DimToBlankTimeout"
+#define MCE_CONF_DISPLAY_PANEL_LPM_KEY "PanelLowPowerDim"
+#define MCE_CONF_DISPLAY_EXTERNAL_OUTPUTS_KEY "ExternalOutputs"
 
 #define MCE_BRIGHTNESS_KEY	"display_brightness"
 
@@ -46,5 +48,26 @@
 #define DEFAULT_MAXIMUM_DISPLAY_BRIGHTNESS	127
 #define DEFAULT_DIM_BRIGHTNESS			10
 #define DEFAULT_ENABLE_POWER_SAVING		TRUE
+#define DEFAULT_PANEL_LPM_DIM			TRUE
+#define DEFAULT_EXTERNAL_OUTPUTS		FALSE
+
+/** Globs for SysFS directories that may hold panel power mode attributes */
+#define DISPLAY_PANEL_MODE_GLOBS		"/sys/class/drm/card*-*/", \
+						"/sys/class/graphics/fb*/device/"
+
+/** Glob for the connection status of DRM connectors */
+#define DISPLAY_DRM_CONNECTOR_STATUS_GLOB	"/sys/class/drm/card*-*/status"
+
+/** Connected state of a DRM connector */
+#define DISPLAY_DRM_CONNECTOR_CONNECTED		"connected"
+
+/** Force a DRM connector off */
+#define DISPLAY_DRM_CONNECTOR_FORCE_OFF		"off"
+
+/** Return a DRM connector to hotplug detection */
+#define DISPLAY_DRM_CONNECTOR_DETECT		"detect"
+
+/** DRM connector types that drive the internal panel */
+#define DISPLAY_DRM_INTERNAL_CONNECTORS		"eDP-", "LVDS-", "DSI-", "DPI-"
 
 #endif /* _DISPLAY_H_ */
@@ -31,6 +31,27 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 #define MCE_CONF_VIBRATOR_GROUP			"Vibrator"
 #define MCE_CONF_VIBRATOR_PATTERNS		"VibratorPatterns"
+/** Configuration key for the LED class vibrator directory */
+#define MCE_CONF_VIBRATOR_LED_PATH		"LedPath"
+/** Configuration key for the timed_output vibrator directory */
+#define MCE_CONF_VIBRATOR_TIMED_OUTPUT_PATH	"TimedOutputPath"
+
+/** Default LED class vibrator directory */
+#define DEFAULT_VIBRATOR_LED_PATH		"/sys/class/leds/vibrator"
+/** Default timed_output vibrator directory */
+#define DEFAULT_VIBRATOR_TIMED_OUTPUT_PATH	"/sys/class/timed_output/vibrator"
+
+/** Vibrator backends */
+typedef enum {
+	/** No usable vibrator */
+	VIBRATOR_BACKEND_NONE,
+	/** evdev force feedback device */
+	VIBRATOR_BACKEND_EVDEV,
+	/** LED class device with the transient trigger */
+	VIBRATOR_BACKEND_LED_TRANSIENT,
+	/** Legacy timed_output device */
+	VIBRATOR_BACKEND_TIMED_OUTPUT
+} vibrator_backend_t;
 
 typedef struct fffeatures {
 	bool constant:1;	/* can render constant force effects */
@@ -54,6 +75,18 @@ typedef struct fffeatures {
 int evdev_fd = -1;
 bool vibratorArmed = true;
 
+static vibrator_backend_t backend = VIBRATOR_BACKEND_NONE;
+/** sysfs directory of a kernel timed vibrator */
+static gchar *kernel_path = NULL;
+/** On period of each segment of the running kernel timed pattern */
+static gint kernel_on_period = 0;
+/** Segments left of the running kernel timed pattern, -1 for infinite */
+static gint kernel_segments_left = 0;
+/** Timer starting the segments of the running kernel timed pattern */
+static guint kernel_segment_cb_id = 0;
+/** Is the vibrator enabled by policy, for example while face down? */
+static bool vibrator_enabled = true;
+
 typedef struct pattern_t {
 	char *name;
 	int_fast32_t priority;
@@ -229,6 +262,212 @@ static bool ff_device_stop(const int fd)
 	return ff_device_run(fd, 1, 0, 1, 0, 0, 0);
 }
 
+/**
+ * Write a file in the directory of the kernel timed vibrator
+ *
+ * @param name The file name
+ * @param string The string to write
+ * @return true on success, false on failure
+ */
+static bool kernel_device_write(const gchar *const name,
+				const gchar *const string)
+{
+	gchar *file = g_strdup_printf("%s/%s", kernel_path, name);
+	bool status = mce_write_string_to_file(file, string);
+
+	g_free(file);
+
+	return status;
+}
+
+/**
+ * Let the kernel run the vibrator for a while; the kernel
+ * turns it off again, so no timer is needed for the off edge
+ *
+ * @param lengthMs The time to vibrate, in milliseconds
+ * @return true on success, false on failure
+ */
+static bool kernel_device_vibrate(const gint lengthMs)
+{
+	gchar *duration = g_strdup_printf("%d", lengthMs);
+	bool status = false;
+
+	if (backend == VIBRATOR_BACKEND_TIMED_OUTPUT) {
+		status = kernel_device_write("enable", duration);
+	} else {
+		status = (kernel_device_write("duration", duration) &&
+			  kernel_device_write("state", "1") &&
+			  kernel_device_write("activate", "1"));
+	}
+
+	g_free(duration);
+
+	return status;
+}
+
+/**
+ * Start the next segment of a kernel timed pattern
+ *
+ * @param data Unused
+ * @return TRUE while segments are left, FALSE to disable the timer
+ */
+static gboolean kernel_segment_cb(gpointer data)
+{
+	(void)data;
+
+	if (kernel_segments_left > 0)
+		kernel_segments_left--;
+
+	(void)kernel_device_vibrate(kernel_on_period);
+
+	if (kernel_segments_left == 0) {
+		kernel_segment_cb_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Stop a kernel timed vibrator
+ *
+ * @return true on success, false on failure
+ */
+static bool kernel_device_stop(void)
+{
+	if (kernel_segment_cb_id != 0) {
+		g_source_remove(kernel_segment_cb_id);
+		kernel_segment_cb_id = 0;
+	}
+
+	kernel_segments_left = 0;
+
+	if (backend == VIBRATOR_BACKEND_TIMED_OUTPUT)
+		return kernel_device_write("enable", "0");
+	else
+		return kernel_device_write("activate", "0");
+}
+
+/**
+ * Run a pattern on a kernel timed vibrator
+ *
+ * Each segment is a single duration write that the kernel times;
+ * the segments of a pattern are started by one periodic timer
+ *
+ * @param lengthMs The on period of each segment
+ * @param delayMs The off period between segments
+ * @param count The number of segments, INT_MAX for infinite
+ * @return true on success, false on failure
+ */
+static bool kernel_device_run(const int lengthMs, const int delayMs,
+			      const int count)
+{
+	(void)kernel_device_stop();
+
+	if (lengthMs <= 0 || count <= 0)
+		return true;
+
+	/* Back to back segments are one long segment */
+	if (delayMs <= 0 && count != INT_MAX &&
+	    (gint64)lengthMs * count <= G_MAXINT32)
+		return kernel_device_vibrate(lengthMs * count);
+
+	if (kernel_device_vibrate(lengthMs) == false)
+		return false;
+
+	if (count > 1) {
+		kernel_on_period = lengthMs;
+		kernel_segments_left = (count == INT_MAX) ? -1 : count - 1;
+		kernel_segment_cb_id = g_timeout_add(lengthMs + MAX(delayMs, 0),
+						     kernel_segment_cb, NULL);
+	}
+
+	return true;
+}
+
+/**
+ * Probe for a kernel timed vibrator
+ *
+ * @return true if one was found, false otherwise
+ */
+static bool kernel_device_open(void)
+{
+	gchar *file = NULL;
+
+	kernel_path = mce_conf_get_string(MCE_CONF_VIBRATOR_GROUP,
+					  MCE_CONF_VIBRATOR_LED_PATH,
+					  DEFAULT_VIBRATOR_LED_PATH, NULL);
+	file = g_strconcat(kernel_path, "/trigger", NULL);
+
+	/* The transient trigger creates its files once selected */
+	if (g_file_test(file, G_FILE_TEST_EXISTS) == TRUE &&
+	    mce_write_string_to_file(file, "transient") == TRUE) {
+		g_free(file);
+		file = g_strconcat(kernel_path, "/activate", NULL);
+
+		if (g_file_test(file, G_FILE_TEST_EXISTS) == TRUE) {
+			backend = VIBRATOR_BACKEND_LED_TRANSIENT;
+			goto EXIT;
+		}
+	}
+
+	g_free(file);
+	g_free(kernel_path);
+
+	kernel_path = mce_conf_get_string(MCE_CONF_VIBRATOR_GROUP,
+					  MCE_CONF_VIBRATOR_TIMED_OUTPUT_PATH,
+					  DEFAULT_VIBRATOR_TIMED_OUTPUT_PATH,
+					  NULL);
+	file = g_strconcat(kernel_path, "/enable", NULL);
+
+	if (g_file_test(file, G_FILE_TEST_EXISTS) == TRUE) {
+		backend = VIBRATOR_BACKEND_TIMED_OUTPUT;
+		goto EXIT;
+	}
+
+	g_free(kernel_path);
+	kernel_path = NULL;
+
+EXIT:
+	g_free(file);
+
+	return backend != VIBRATOR_BACKEND_NONE;
+}
+
+/**
+ * Run a pattern on the vibrator backend in use
+ *
+ * Kernel timed vibrators have no strength or envelope,
+ * the accelerate and decelerate periods count as on time
+ */
+static bool vibrator_run(const int lengthMs, const int delayMs,
+			 const int count, const uint8_t strength,
+			 const short attackLengthMs, const short fadeLengthMs)
+{
+	if (backend == VIBRATOR_BACKEND_EVDEV)
+		return ff_device_run(evdev_fd, lengthMs, delayMs, count,
+				     strength, attackLengthMs, fadeLengthMs);
+
+	if (backend == VIBRATOR_BACKEND_NONE)
+		return false;
+
+	return kernel_device_run(lengthMs, delayMs, count);
+}
+
+/**
+ * Stop the vibrator backend in use
+ */
+static bool vibrator_stop(void)
+{
+	if (backend == VIBRATOR_BACKEND_EVDEV)
+		return ff_device_stop(evdev_fd);
+
+	if (backend == VIBRATOR_BACKEND_NONE)
+		return false;
+
+	return kernel_device_stop();
+}
+
 static gboolean priority_timeout_cb(gpointer data)
 {
 	(void)data;
@@ -292,7 +531,8 @@ static gboolean should_run_pattern(const pattern_t pattern)
 
 static gboolean run_pattern(const pattern_t pattern)
 {
-	if (!pattern.invalid && vibratorArmed && should_run_pattern(pattern)) {
+	if (!pattern.invalid && vibratorArmed && vibrator_enabled &&
+	    should_run_pattern(pattern)) {
 		if (pattern.priority < priority) {
 			priority = pattern.priority;
 			int count;
@@ -308,14 +548,13 @@ static gboolean run_pattern(const pattern_t pattern)
 			}
 			if( ((int64_t)count)*(pattern.accel_period + pattern.on_period + pattern.decel_period) < INT_MAX )
 				setup_priority_timeout((pattern.accel_period + pattern.on_period + pattern.decel_period)*count);
-			return ff_device_run(evdev_fd,
-					     pattern.accel_period +
-					     pattern.on_period +
-					     pattern.decel_period,
-					     pattern.off_period, count,
-					     pattern.speed,
-					     pattern.accel_period,
-					     pattern.decel_period);
+			return vibrator_run(pattern.accel_period +
+					    pattern.on_period +
+					    pattern.decel_period,
+					    pattern.off_period, count,
+					    pattern.speed,
+					    pattern.accel_period,
+					    pattern.decel_period);
 		}
 	}
 	return true;
@@ -354,7 +593,7 @@ static gboolean vibrator_activate_pattern_dbus_cb(DBusMessage * const msg)
 static gboolean vibrator_deactivate_pattern_dbus_cb(DBusMessage * const msg)
 {
 	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
-	if (!ff_device_stop(evdev_fd))
+	if (!vibrator_stop())
 		return false;
 	
 	cancel_priority_timeout();
@@ -489,9 +728,8 @@ static gboolean vibrator_start_manual_vibration_cb(DBusMessage * msg)
 		if (priority == 256)
 		{
 			setup_priority_timeout(duration);
-			if (!ff_device_run
-			    (evdev_fd, duration, 0, 1, speed, 0, 0)) {
-				mce_log(LL_WARN, "%s: ff_device_run returned false", MODULE_NAME);
+			if (!vibrator_run(duration, 0, 1, speed, 0, 0)) {
+				mce_log(LL_WARN, "%s: vibrator_run returned false", MODULE_NAME);
 			}
 		}
 		if (no_reply == false) {
@@ -522,6 +760,19 @@ static void call_state_trigger(gconstpointer data)
 	call_state = datapipe_get_gint(call_state_pipe);
 }
 
+static void vibrator_enabled_trigger(gconstpointer data)
+{
+	(void)data;
+	vibrator_enabled = datapipe_get_gbool(vibrator_enabled_pipe);
+
+	/* Silence any pattern that is already running */
+	if (vibrator_enabled == false) {
+		vibrator_stop();
+		cancel_priority_timeout();
+		priority = 256;
+	}
+}
+
 static void vibrator_pattern_activate_trigger(gconstpointer data)
 {
 	run_pattern(find_pattern((const char *)data));
@@ -530,7 +781,7 @@ static void vibrator_pattern_activate_trigger(gconstpointer data)
 static void vibrator_pattern_deactivate_trigger(gconstpointer data)
 {
 	(void)data;
-	ff_device_stop(evdev_fd);
+	vibrator_stop();
 }
 
 static void scan_device_cb(const char *filename)
@@ -564,8 +815,11 @@ const char *g_module_check_init(GModule * module)
 	append_output_trigger_to_datapipe(&display_state_pipe,
 					  display_state_trigger);
 	append_output_trigger_to_datapipe(&call_state_pipe, call_state_trigger);
+	append_output_trigger_to_datapipe(&vibrator_enabled_pipe,
+					  vibrator_enabled_trigger);
 
 	display_state = datapipe_get_gint(display_state_pipe);
+	vibrator_enabled = datapipe_get_gbool(vibrator_enabled_pipe);
 	system_state = datapipe_get_gint(system_state_pipe);
 	call_state = datapipe_get_gint(call_state_pipe);
 
@@ -576,9 +830,14 @@ const char *g_module_check_init(GModule * module)
 
 	mce_scan_inputdevices(&scan_device_cb);
 
-	if (evdev_fd < 0) {
+	if (evdev_fd >= 0) {
+		backend = VIBRATOR_BACKEND_EVDEV;
+	} else if (kernel_device_open() == true) {
+		mce_log(LL_INFO, "%s: Using %s for kernel timed vibration",
+			MODULE_NAME, kernel_path);
+	} else {
 		mce_log(LL_WARN,
-			"%s: No usable force feedback device available, vibration disabled.", MODULE_NAME);
+			"%s: No usable vibrator device available, vibration disabled.", MODULE_NAME);
 		return NULL;
 	}
 
@@ -652,8 +911,19 @@ void g_module_unload(GModule * module)
 
 	cancel_priority_timeout();
 
+	if (backend != VIBRATOR_BACKEND_NONE)
+		(void)vibrator_stop();
+
+	if (backend == VIBRATOR_BACKEND_LED_TRANSIENT)
+		(void)kernel_device_write("trigger", "none");
+
+	g_free(kernel_path);
+	kernel_path = NULL;
+
 	free_patterns();
 
+	remove_output_trigger_from_datapipe(&vibrator_enabled_pipe,
+					    vibrator_enabled_trigger);
 	remove_output_trigger_from_datapipe(&call_state_pipe,
 					    call_state_trigger);
 	remove_output_trigger_from_datapipe(&display_state_pipe,
@@ -6,6 +6,7 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <mce/mode-names.h>
 #include "mce.h"
@@ -19,37 +20,166 @@
 
 #define MODULE_PROVIDES	"accelerometer"
 
+/** Name of the configuration group for this module */
+#define MCE_CONF_IIO_ACCEL_GROUP		"IioAccelerometer"
+
+/** Configuration key for using the kernel IIO device directly */
+#define MCE_CONF_IIO_ACCEL_DIRECT		"DirectBackend"
+
+/** Configuration key for the IIO sysfs device directory */
+#define MCE_CONF_IIO_ACCEL_SYSFS_PATH		"SysfsPath"
+
+/** Configuration key for the IIO character device directory */
+#define MCE_CONF_IIO_ACCEL_DEV_PATH		"DevPath"
+
+/** Configuration key for the raw sysfs poll interval */
+#define MCE_CONF_IIO_ACCEL_POLL_INTERVAL	"PollInterval"
+
+/** Configuration key for blanking the display while face down */
+#define MCE_CONF_IIO_ACCEL_FACE_DOWN_POLICY	"FaceDownPolicy"
+
+/** Configuration key for the time the device has to stay face down */
+#define MCE_CONF_IIO_ACCEL_FACE_DOWN_DELAY	"FaceDownDelay"
+
+/** Default IIO sysfs device directory */
+#define DEFAULT_IIO_SYSFS_PATH			"/sys/bus/iio/devices"
+
+/** Default IIO character device directory */
+#define DEFAULT_IIO_DEV_PATH			"/dev"
+
+/** Default raw sysfs poll interval, in milliseconds */
+#define DEFAULT_IIO_POLL_INTERVAL		200
+
+/** Default time the device has to stay face down, in milliseconds */
+#define DEFAULT_FACE_DOWN_DELAY			1000
+
+/** Number of samples the kernel buffers for the direct backend */
+#define IIO_BUFFER_LENGTH			16
+
 static const char *const provides[] = { MODULE_PROVIDES, NULL };
 
 G_MODULE_EXPORT module_info_struct module_info = {
 	.name = MODULE_NAME,
 	.provides = provides,
-	.priority = 100
+	.priority = 100,
+	.active_states = MCE_STATE_MASK(MCE_STATE_USER) |
+			 MCE_STATE_MASK(MCE_STATE_BOOT)
 };
 
 typedef enum {
 	ORIENTATION_UNKNOWN,
 	ORIENTATION_LANDSCAPE,
-	ORIENTATION_PORTRAIT
+	ORIENTATION_PORTRAIT,
+	ORIENTATION_LANDSCAPE_INVERTED,
+	ORIENTATION_PORTRAIT_INVERTED
 } oritation_t;
 
+/** Orientation names used by iio-sensor-proxy */
+static const struct {
+	const char *name;
+	oritation_t oritation;
+} iio_proxy_oritations[] = {
+	{ "undefined", ORIENTATION_UNKNOWN },
+	{ "normal", ORIENTATION_LANDSCAPE },
+	{ "bottom-up", ORIENTATION_LANDSCAPE_INVERTED },
+	{ "left-up", ORIENTATION_PORTRAIT },
+	{ "right-up", ORIENTATION_PORTRAIT_INVERTED },
+	{ NULL, ORIENTATION_UNKNOWN }
+};
+
+/** Layout of an accelerometer axis in the IIO buffer */
+typedef struct {
+	/** Scan index of the channel */
+	guint index;
+	/** Byte offset of the channel in a sample */
+	guint offset;
+	/** Storage size in bytes */
+	guint bytes;
+	/** Number of valid bits */
+	guint bits;
+	/** Right shift to apply to the stored value */
+	guint shift;
+	/** Is the value signed? */
+	bool is_signed;
+	/** Is the value stored big endian? */
+	bool big_endian;
+} iio_channel_t;
+
 static display_state_t display_state = { 0 };
 static alarm_ui_state_t alarm_state = { 0 };
 static call_state_t call_state = { 0 };
 
 static unsigned int watch_id = 0;
 static GDBusProxy *iio_proxy = NULL;
+/** Has the module been quiesced by mce_module_quiesce()? */
+static bool quiesced = false;
+/** Has the name watcher reported that iio-sensor-proxy is not running? */
+static bool proxy_vanished = false;
 
 static GSList *accelerometer_listeners = NULL;
 
 static oritation_t oritation = ORIENTATION_UNKNOWN;
+static bool face_down = false;
+
+/** Blank the display and silence notifications while face down */
+static gboolean face_down_policy = FALSE;
+static gint face_down_delay = DEFAULT_FACE_DOWN_DELAY;
+/** Timeout for applying the face down policy */
+static guint face_down_timeout_cb_id = 0;
+/** Has the face down policy blanked the display? */
+static bool face_down_blanked = false;
+/** LED and vibrator states to restore when the device is picked up */
+static gboolean face_down_saved_led = TRUE;
+static gboolean face_down_saved_vibrator = TRUE;
+
+/** Use the kernel IIO device when iio-sensor-proxy is not running */
+static gboolean iio_direct_enabled = TRUE;
+static gchar *iio_sysfs_path = NULL;
+static gchar *iio_dev_path = NULL;
+static gint iio_poll_interval = DEFAULT_IIO_POLL_INTERVAL;
+
+/** sysfs directory of the accelerometer, NULL if none was found */
+static gchar *iio_direct_device = NULL;
+/** Character device of the accelerometer */
+static gchar *iio_direct_chardev = NULL;
+/** Buffer layout of the x, y and z axes */
+static iio_channel_t iio_direct_axes[3];
+/** Size of one buffered sample, in bytes */
+static guint iio_direct_sample_size = 0;
+/** I/O monitor for the buffered samples */
+static gconstpointer iio_direct_iomon = NULL;
+/** Raw sysfs poll timer, used when buffered reads are unavailable */
+static guint iio_direct_poll_id = 0;
+
+/**
+ * Check whether samples come from the kernel device rather than
+ * iio-sensor-proxy; only the direct backend reports face up/down
+ *
+ * @return true if the direct backend is in use, false otherwise
+ */
+static bool iio_accel_direct_backend(void)
+{
+	return (iio_direct_enabled == TRUE && iio_proxy == NULL &&
+		proxy_vanished == true);
+}
 
 static bool iio_accel_claim_policy(void)
 {
-	return g_slist_length(accelerometer_listeners) > 0 && 
-	       (display_state != MCE_DISPLAY_OFF || 
-	       alarm_state == MCE_ALARM_UI_RINGING_INT32 || 
-	       call_state == CALL_STATE_RINGING);
+	if (quiesced)
+		return false;
+
+	bool active = (display_state != MCE_DISPLAY_OFF ||
+		       alarm_state == MCE_ALARM_UI_RINGING_INT32 ||
+		       call_state == CALL_STATE_RINGING);
+
+	/* The face down policy keeps the sensor claimed while it has
+	 * blanked the display, to notice when the device is picked up
+	 */
+	if (face_down_policy == TRUE && iio_accel_direct_backend() &&
+	    (active || face_down_blanked))
+		return true;
+
+	return g_slist_length(accelerometer_listeners) > 0 && active;
 }
 
 static const char *iio_oritation_to_str(const oritation_t orit)
@@ -59,6 +189,10 @@ static const char *iio_oritation_to_str(const oritation_t orit)
 			return MCE_ORIENTATION_LANDSCAPE;
 		case ORIENTATION_PORTRAIT: 
 			return MCE_ORIENTATION_PORTRAIT;
+		case ORIENTATION_LANDSCAPE_INVERTED:
+			return MCE_ORIENTATION_LANDSCAPE_INVERTED;
+		case ORIENTATION_PORTRAIT_INVERTED:
+			return MCE_ORIENTATION_PORTRAIT_INVERTED;
 		default:
 			return MCE_ORIENTATION_UNKNOWN;
 	}
@@ -68,7 +202,8 @@ static gboolean send_device_orientation(DBusMessage *const method_call)
 {
 	const gchar *srotation = iio_oritation_to_str(oritation);
 	const gchar *sstand = MCE_ORIENTATION_OFF_STAND;
-	const gchar *sface = MCE_ORIENTATION_FACE_UP;
+	const gchar *sface = face_down ? MCE_ORIENTATION_FACE_DOWN :
+					 MCE_ORIENTATION_FACE_UP;
 	dbus_int32_t maxInt = G_MAXINT32;
 	DBusMessage *msg = NULL;
 	
@@ -101,39 +236,589 @@ static gboolean send_device_orientation(DBusMessage *const method_call)
 	return dbus_send_message(msg);
 }
 
+/**
+ * Silence or restore the LEDs and the vibrator
+ *
+ * @param silence true to silence, false to restore the saved states
+ */
+static void face_down_silence(const bool silence)
+{
+	if (silence == true) {
+		face_down_saved_led = datapipe_get_gbool(led_enabled_pipe);
+		face_down_saved_vibrator =
+			datapipe_get_gbool(vibrator_enabled_pipe);
+	}
+
+	(void)execute_datapipe(&led_enabled_pipe,
+			       GINT_TO_POINTER(silence ? FALSE :
+					       face_down_saved_led),
+			       USE_INDATA, CACHE_INDATA);
+	(void)execute_datapipe(&vibrator_enabled_pipe,
+			       GINT_TO_POINTER(silence ? FALSE :
+					       face_down_saved_vibrator),
+			       USE_INDATA, CACHE_INDATA);
+}
+
+/**
+ * Timeout callback for blanking the display once the device
+ * has stayed face down for long enough
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean face_down_timeout_cb(gpointer data)
+{
+	(void)data;
+
+	face_down_timeout_cb_id = 0;
+
+	/* Leave calls in progress to the proximity sensor */
+	if (face_down == false || display_state == MCE_DISPLAY_OFF ||
+	    call_state == CALL_STATE_ACTIVE)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: face down; blanking display", MODULE_NAME);
+
+	face_down_blanked = true;
+	face_down_silence(true);
+
+	/* Don't put the lock screen over an incoming call or alarm */
+	if (call_state != CALL_STATE_RINGING &&
+	    alarm_state != MCE_ALARM_UI_RINGING_INT32)
+		(void)execute_datapipe(&tk_lock_pipe,
+				       GINT_TO_POINTER(LOCK_ON),
+				       USE_INDATA, CACHE_INDATA);
+
+	(void)execute_datapipe(&display_state_pipe,
+			       GINT_TO_POINTER(MCE_DISPLAY_OFF),
+			       USE_INDATA, CACHE_INDATA);
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Forget about a face down blank without touching the display,
+ * restoring the LEDs and the vibrator
+ */
+static void face_down_reset(void)
+{
+	if (face_down_timeout_cb_id != 0) {
+		g_source_remove(face_down_timeout_cb_id);
+		face_down_timeout_cb_id = 0;
+	}
+
+	if (face_down_blanked == true) {
+		face_down_blanked = false;
+		face_down_silence(false);
+	}
+}
+
+/**
+ * Apply the face down policy after the face of the device changed;
+ * turning it face down blanks the display after a delay,
+ * picking it up again unblanks the display into the lock screen
+ */
+static void face_down_changed(void)
+{
+	if (face_down_policy == FALSE)
+		return;
+
+	if (face_down_timeout_cb_id != 0) {
+		g_source_remove(face_down_timeout_cb_id);
+		face_down_timeout_cb_id = 0;
+	}
+
+	if (face_down == true) {
+		if (display_state != MCE_DISPLAY_OFF &&
+		    face_down_blanked == false)
+			face_down_timeout_cb_id =
+				g_timeout_add(face_down_delay,
+					      face_down_timeout_cb, NULL);
+	} else if (face_down_blanked == true) {
+		mce_log(LL_DEBUG, "%s: picked up; unblanking display",
+			MODULE_NAME);
+
+		face_down_blanked = false;
+		face_down_silence(false);
+
+		(void)execute_datapipe(&display_state_pipe,
+				       GINT_TO_POINTER(MCE_DISPLAY_ON),
+				       USE_INDATA, CACHE_INDATA);
+	}
+}
+
+/**
+ * Update the orientation, broadcasting it only if it changed
+ *
+ * @param orit The new rotation
+ * @param down true if the device is face down, false otherwise
+ */
+static void iio_accel_set_orientation(const oritation_t orit, const bool down)
+{
+	bool face_changed = (down != face_down);
+
+	if (orit == oritation && face_changed == false)
+		return;
+
+	oritation = orit;
+	face_down = down;
+
+	mce_log(LL_DEBUG, "%s: oritation: %s, %s", MODULE_NAME,
+		iio_oritation_to_str(oritation),
+		face_down ? MCE_ORIENTATION_FACE_DOWN : MCE_ORIENTATION_FACE_UP);
+	send_device_orientation(NULL);
+
+	if (face_changed == true)
+		face_down_changed();
+}
+
 static void iio_accel_get_value(GDBusProxy * proxy)
 {
 	GVariant *v;
+	const char *name;
+
 	v = g_dbus_proxy_get_cached_property (proxy, "AccelerometerOrientation");
-	
-	bool changed = false;
+	if (v == NULL)
+		return;
 
-	if (strcmp(g_variant_get_string(v, NULL), "undefined") == 0) {
-		oritation = ORIENTATION_UNKNOWN;
-		changed = true;
+	name = g_variant_get_string(v, NULL);
+
+	for (int i = 0; iio_proxy_oritations[i].name != NULL; i++) {
+		if (strcmp(name, iio_proxy_oritations[i].name) == 0) {
+			/* iio-sensor-proxy does not report face up/down */
+			iio_accel_set_orientation(iio_proxy_oritations[i].oritation,
+						  face_down);
+			break;
+		}
 	}
-	else if (strcmp(g_variant_get_string(v, NULL), "normal") == 0) {
-		oritation = ORIENTATION_LANDSCAPE;
-		changed = true;
+	g_variant_unref(v);
+}
+
+/**
+ * Derive the orientation from an acceleration vector,
+ * using the same 35 degree tilt threshold as iio-sensor-proxy
+ *
+ * Only the direction of the vector matters,
+ * so the axes do not need to be scaled as long as they share a scale
+ *
+ * @param x Acceleration along the x axis
+ * @param y Acceleration along the y axis
+ * @param z Acceleration along the z axis
+ */
+static void iio_direct_evaluate(const gint64 x, const gint64 y, const gint64 z)
+{
+	gint64 total = x * x + y * y + z * z;
+	oritation_t orit = oritation;
+	bool down = face_down;
+
+	if (total == 0)
+		return;
+
+	/* sin²(35°) is roughly 1/3; a device lying flat keeps its rotation */
+	if (3 * x * x > total)
+		orit = (x > 0) ? ORIENTATION_PORTRAIT :
+				 ORIENTATION_PORTRAIT_INVERTED;
+	else if (3 * y * y > total)
+		orit = (y > 0) ? ORIENTATION_LANDSCAPE_INVERTED :
+				 ORIENTATION_LANDSCAPE;
+
+	/* An upright device keeps its face */
+	if (3 * z * z > total)
+		down = (z < 0);
+
+	iio_accel_set_orientation(orit, down);
+}
+
+/**
+ * Read a file in the sysfs directory of the accelerometer
+ *
+ * @param name Path of the file relative to the device directory
+ * @return The stripped contents, or NULL on failure; free with g_free()
+ */
+static gchar *iio_direct_read(const gchar *name)
+{
+	gchar *path = g_build_filename(iio_direct_device, name, NULL);
+	gchar *string = NULL;
+
+	if (g_file_get_contents(path, &string, NULL, NULL) == TRUE)
+		g_strstrip(string);
+
+	g_free(path);
+
+	return string;
+}
+
+/**
+ * Write a file in the sysfs directory of the accelerometer
+ *
+ * @param name Path of the file relative to the device directory
+ * @param string The string to write
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean iio_direct_write(const gchar *name, const gchar *string)
+{
+	gchar *path = g_build_filename(iio_direct_device, name, NULL);
+	gboolean status = mce_write_string_to_file(path, string);
+
+	g_free(path);
+
+	return status;
+}
+
+/**
+ * Find an accelerometer among the kernel IIO devices
+ *
+ * @return true if an accelerometer was found, false otherwise
+ */
+static bool iio_direct_find_device(void)
+{
+	const gchar *entry;
+	GDir *dir;
+
+	if (iio_direct_device != NULL)
+		return true;
+
+	if ((dir = g_dir_open(iio_sysfs_path, 0, NULL)) == NULL)
+		return false;
+
+	while ((entry = g_dir_read_name(dir)) != NULL) {
+		gchar *path;
+
+		if (g_str_has_prefix(entry, "iio:device") == FALSE)
+			continue;
+
+		path = g_build_filename(iio_sysfs_path, entry,
+					"in_accel_x_raw", NULL);
+
+		if (g_file_test(path, G_FILE_TEST_EXISTS) == TRUE) {
+			iio_direct_device = g_build_filename(iio_sysfs_path,
+							     entry, NULL);
+			iio_direct_chardev = g_build_filename(iio_dev_path,
+							      entry, NULL);
+		}
+
+		g_free(path);
+
+		if (iio_direct_device != NULL)
+			break;
 	}
-	else if (strcmp(g_variant_get_string(v, NULL), "left-up") == 0) {
-		oritation = ORIENTATION_PORTRAIT;
-		changed = true;
+
+	g_dir_close(dir);
+
+	if (iio_direct_device != NULL)
+		mce_log(LL_INFO, "%s: using IIO accelerometer %s",
+			MODULE_NAME, iio_direct_device);
+
+	return iio_direct_device != NULL;
+}
+
+/**
+ * Parse the scan index and type of an accelerometer axis
+ *
+ * @param axis The axis; 'x', 'y' or 'z'
+ * @param channel The channel to fill in
+ * @return true on success, false on failure
+ */
+static bool iio_direct_parse_channel(const char axis, iio_channel_t *channel)
+{
+	gchar *name = g_strdup_printf("scan_elements/in_accel_%c_index", axis);
+	gchar *index = iio_direct_read(name);
+	gchar *type;
+	char endian;
+	char sign;
+	bool status = false;
+
+	g_free(name);
+	name = g_strdup_printf("scan_elements/in_accel_%c_type", axis);
+	type = iio_direct_read(name);
+	g_free(name);
+
+	if (index == NULL || type == NULL)
+		goto EXIT;
+
+	/* For example "le:s12/16>>4" */
+	if (sscanf(type, "%ce:%c%u/%u>>%u", &endian, &sign, &channel->bits,
+		   &channel->bytes, &channel->shift) != 5 ||
+	    channel->bytes == 0 || channel->bytes > 32 ||
+	    channel->bytes % 8 != 0 || channel->bits == 0 ||
+	    channel->bits > channel->bytes) {
+		mce_log(LL_WARN, "%s: unsupported scan type `%s' for %c axis",
+			MODULE_NAME, type, axis);
+		goto EXIT;
 	}
-	g_variant_unref(v);
-	
-	if (changed) {
-		mce_log(LL_DEBUG, "%s: oritation: %s", MODULE_NAME, iio_oritation_to_str(oritation));
-		send_device_orientation(NULL);
+
+	channel->index = strtoul(index, NULL, 10);
+	channel->bytes /= 8;
+	channel->is_signed = (sign == 's');
+	channel->big_endian = (endian == 'b');
+	status = true;
+
+EXIT:
+	g_free(index);
+	g_free(type);
+
+	return status;
+}
+
+/**
+ * Set up the IIO buffer for the x, y and z axes
+ *
+ * @return true if buffered samples can be read, false otherwise
+ */
+static bool iio_direct_setup_buffer(void)
+{
+	const gchar *entry;
+	gchar *path;
+	gchar *trigger;
+	guint offset = 0;
+	guint align = 1;
+	iio_channel_t *order[3];
+	GDir *dir;
+
+	(void)iio_direct_write("buffer/enable", "0");
+
+	/* Scan only the accelerometer axes */
+	path = g_build_filename(iio_direct_device, "scan_elements", NULL);
+	dir = g_dir_open(path, 0, NULL);
+	g_free(path);
+
+	if (dir == NULL)
+		return false;
+
+	while ((entry = g_dir_read_name(dir)) != NULL) {
+		gchar *name;
+
+		if (g_str_has_suffix(entry, "_en") == FALSE)
+			continue;
+
+		name = g_build_filename("scan_elements", entry, NULL);
+		(void)iio_direct_write(name,
+				       (strcmp(entry, "in_accel_x_en") == 0 ||
+					strcmp(entry, "in_accel_y_en") == 0 ||
+					strcmp(entry, "in_accel_z_en") == 0) ?
+				       "1" : "0");
+		g_free(name);
+	}
+
+	g_dir_close(dir);
+
+	if (iio_direct_parse_channel('x', &iio_direct_axes[0]) == false ||
+	    iio_direct_parse_channel('y', &iio_direct_axes[1]) == false ||
+	    iio_direct_parse_channel('z', &iio_direct_axes[2]) == false)
+		return false;
+
+	/* Channels are stored in scan index order, each naturally aligned */
+	for (int i = 0; i < 3; i++)
+		order[i] = &iio_direct_axes[i];
+
+	for (int i = 1; i < 3; i++) {
+		for (int j = i; j > 0 && order[j]->index < order[j - 1]->index; j--) {
+			iio_channel_t *tmp = order[j];
+
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		offset = (offset + order[i]->bytes - 1) /
+			 order[i]->bytes * order[i]->bytes;
+		order[i]->offset = offset;
+		offset += order[i]->bytes;
+
+		if (order[i]->bytes > align)
+			align = order[i]->bytes;
+	}
+
+	iio_direct_sample_size = (offset + align - 1) / align * align;
+
+	/* Use the data ready trigger of the device unless one is set */
+	trigger = iio_direct_read("trigger/current_trigger");
+
+	if (trigger == NULL) {
+		return false;
+	} else if (trigger[0] == '\0') {
+		gchar *name = iio_direct_read("name");
+		const gchar *device = strrchr(iio_direct_device, ':');
+
+		g_free(trigger);
+		trigger = g_strdup_printf("%s-dev%s", name ? name : "",
+					  device ? device + strlen(":device") : "");
+		g_free(name);
+
+		if (iio_direct_write("trigger/current_trigger",
+				     trigger) == FALSE) {
+			g_free(trigger);
+			return false;
+		}
 	}
+
+	g_free(trigger);
+
+	path = g_strdup_printf("%d", IIO_BUFFER_LENGTH);
+	(void)iio_direct_write("buffer/length", path);
+	g_free(path);
+
+	return iio_direct_write("buffer/enable", "1");
+}
+
+/**
+ * Extract the value of an axis from a buffered sample
+ *
+ * @param sample The sample
+ * @param channel The layout of the axis
+ * @return The sign extended value
+ */
+static gint64 iio_direct_channel_value(const guint8 *sample,
+				       const iio_channel_t *channel)
+{
+	guint64 mask = (G_GUINT64_CONSTANT(1) << channel->bits) - 1;
+	guint64 value = 0;
+
+	for (guint i = 0; i < channel->bytes; i++) {
+		guint byte = channel->big_endian ? i : channel->bytes - 1 - i;
+
+		value = (value << 8) | sample[channel->offset + byte];
+	}
+
+	value = (value >> channel->shift) & mask;
+
+	if (channel->is_signed &&
+	    (value & (G_GUINT64_CONSTANT(1) << (channel->bits - 1))) != 0)
+		value |= ~mask;
+
+	return (gint64)value;
+}
+
+/**
+ * I/O monitor callback for buffered accelerometer samples
+ *
+ * @param data The sample
+ * @param bytes_read The number of bytes read
+ */
+static void iio_direct_sample_cb(gpointer data, gsize bytes_read)
+{
+	const guint8 *sample = data;
+
+	if (bytes_read < iio_direct_sample_size)
+		return;
+
+	iio_direct_evaluate(iio_direct_channel_value(sample, &iio_direct_axes[0]),
+			    iio_direct_channel_value(sample, &iio_direct_axes[1]),
+			    iio_direct_channel_value(sample, &iio_direct_axes[2]));
+}
+
+/**
+ * Timeout callback for polling the raw accelerometer values
+ *
+ * @param data Unused
+ * @return Always returns TRUE, to keep polling
+ */
+static gboolean iio_direct_poll_cb(gpointer data)
+{
+	gint64 value[3];
+	(void)data;
+
+	for (int i = 0; i < 3; i++) {
+		gchar *name = g_strdup_printf("in_accel_%c_raw", 'x' + i);
+		gchar *string = iio_direct_read(name);
+
+		g_free(name);
+
+		if (string == NULL)
+			return TRUE;
+
+		value[i] = g_ascii_strtoll(string, NULL, 10);
+		g_free(string);
+	}
+
+	iio_direct_evaluate(value[0], value[1], value[2]);
+
+	return TRUE;
+}
+
+static void iio_direct_error_cb(gpointer data, const gchar *device,
+				gconstpointer iomon_id, GError *error);
+
+/**
+ * Start reading the kernel IIO accelerometer
+ */
+static void iio_direct_start(void)
+{
+	if (iio_direct_iomon != NULL || iio_direct_poll_id != 0)
+		return;
+
+	if (iio_direct_enabled == FALSE || iio_direct_find_device() == false)
+		return;
+
+	if (iio_direct_setup_buffer() == true)
+		iio_direct_iomon =
+			mce_register_io_monitor_chunk(-1, iio_direct_chardev,
+						      MCE_IO_ERROR_POLICY_WARN,
+						      FALSE,
+						      iio_direct_sample_cb,
+						      iio_direct_sample_size,
+						      iio_direct_error_cb,
+						      NULL);
+
+	if (iio_direct_iomon == NULL) {
+		mce_log(LL_DEBUG, "%s: buffered reads unavailable; "
+			"polling %s", MODULE_NAME, iio_direct_device);
+		(void)iio_direct_write("buffer/enable", "0");
+		iio_direct_poll_id = g_timeout_add(iio_poll_interval,
+						   iio_direct_poll_cb, NULL);
+		iio_direct_poll_cb(NULL);
+	}
+}
+
+/**
+ * Stop reading the kernel IIO accelerometer
+ */
+static void iio_direct_stop(void)
+{
+	if (iio_direct_iomon != NULL) {
+		mce_unregister_io_monitor(iio_direct_iomon);
+		iio_direct_iomon = NULL;
+		(void)iio_direct_write("buffer/enable", "0");
+	}
+
+	if (iio_direct_poll_id != 0) {
+		g_source_remove(iio_direct_poll_id);
+		iio_direct_poll_id = 0;
+	}
+}
+
+/**
+ * I/O monitor error callback; fall back to polling
+ *
+ * @param data Unused
+ * @param device The character device
+ * @param iomon_id The I/O monitor
+ * @param error The error
+ */
+static void iio_direct_error_cb(gpointer data, const gchar *device,
+				gconstpointer iomon_id, GError *error)
+{
+	(void)data;
+	(void)iomon_id;
+
+	mce_log(LL_WARN, "%s: reading %s failed; %s", MODULE_NAME,
+		device, error ? error->message : "");
+
+	iio_direct_stop();
+	iio_direct_poll_id = g_timeout_add(iio_poll_interval,
+					   iio_direct_poll_cb, NULL);
 }
 
 static void iio_accel_dbus_call_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
-	(void)source_object;
+	/* The call keeps its own reference to the proxy; iio_proxy
+	 * may already have been dropped by quiesce or a vanished name */
+	GDBusProxy *proxy = G_DBUS_PROXY(source_object);
 	bool claim = GPOINTER_TO_INT(user_data);
 	GError *error = NULL;
-	GVariant *ret = g_dbus_proxy_call_finish(iio_proxy, res, &error);
+	GVariant *ret = g_dbus_proxy_call_finish(proxy, res, &error);
 
 	if (!ret && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
 		mce_log(LL_WARN, "%s: failed to %s accelerometer %s", MODULE_NAME,
@@ -143,8 +828,8 @@ static void iio_accel_dbus_call_cb(GObject *source_object, GAsyncResult *res, gp
 	}
 	g_clear_pointer(&ret, g_variant_unref);
 
-	if(claim)
-		iio_accel_get_value(iio_proxy);
+	if (claim && proxy == iio_proxy)
+		iio_accel_get_value(proxy);
 }
 
 static bool iio_accel_claim_sensor(bool claim)
@@ -164,6 +849,14 @@ static bool iio_accel_claim_sensor(bool claim)
 		claimed = claim;
 	} else {
 		claimed = false;
+
+		/* Without iio-sensor-proxy, read the kernel device directly;
+		 * until the name watcher has reported, the proxy may still be
+		 * running and own the device's buffer */
+		if (claim && proxy_vanished && !quiesced)
+			iio_direct_start();
+		else
+			iio_direct_stop();
 	}
 	
 	return true;
@@ -196,6 +889,7 @@ static void iio_accel_sensors_appeared(GDBusConnection * connection, const gchar
 
 	mce_log(LL_INFO, "%s: Found iio_sensor_proxy", MODULE_NAME);
 
+	proxy_vanished = false;
 	iio_proxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM,
 						  G_DBUS_PROXY_FLAGS_NONE,
 						  NULL,
@@ -204,6 +898,11 @@ static void iio_accel_sensors_appeared(GDBusConnection * connection, const gchar
 
 	g_signal_connect(G_OBJECT(iio_proxy), "g-properties-changed", G_CALLBACK(iio_accel_properties_changed), NULL);
 
+	/* iio-sensor-proxy takes over from the direct backend;
+	 * it never reports face up/down */
+	iio_direct_stop();
+	face_down_reset();
+
 	if (iio_accel_claim_policy())
 		iio_accel_claim_sensor(true);
 }
@@ -217,8 +916,12 @@ static void iio_accel_sensors_vanished(GDBusConnection * connection, const gchar
 		g_clear_object(&iio_proxy);
 		iio_proxy = NULL;
 		mce_log(LL_WARN, "%s: connection to iio_sensor_proxy lost", MODULE_NAME);
-		iio_accel_claim_sensor(false);
 	}
+
+	proxy_vanished = true;
+
+	/* Fall back to the direct backend */
+	iio_accel_claim_sensor(iio_accel_claim_policy());
 }
 
 static gboolean get_device_orientation_dbus_cb(DBusMessage *const method_call)
@@ -337,6 +1040,11 @@ EXIT:
 static void display_state_trigger(gconstpointer data)
 {
 	display_state = GPOINTER_TO_INT(data);
+
+	/* Something else unblanked the display while face down */
+	if (display_state != MCE_DISPLAY_OFF && face_down_blanked == true)
+		face_down_reset();
+
 	iio_accel_claim_sensor(iio_accel_claim_policy());
 }
 
@@ -352,6 +1060,44 @@ static void call_state_trigger(gconstpointer data)
 	iio_accel_claim_sensor(iio_accel_claim_policy());
 }
 
+/**
+ * Release the sensor and stop watching iio-sensor-proxy
+ * while the system is in a state where the module is inactive
+ */
+G_MODULE_EXPORT void mce_module_quiesce(void);
+void mce_module_quiesce(void)
+{
+	quiesced = true;
+	proxy_vanished = false;
+
+	if (watch_id != 0) {
+		g_bus_unwatch_name(watch_id);
+		watch_id = 0;
+	}
+
+	if (iio_proxy) {
+		iio_accel_claim_sensor(false);
+		g_clear_object(&iio_proxy);
+	}
+
+	iio_direct_stop();
+	face_down_reset();
+}
+
+/**
+ * Watch iio-sensor-proxy again after mce_module_quiesce()
+ */
+G_MODULE_EXPORT void mce_module_resume(void);
+void mce_module_resume(void)
+{
+	quiesced = false;
+
+	if (watch_id == 0)
+		watch_id = g_bus_watch_name(G_BUS_TYPE_SYSTEM, "net.hadess.SensorProxy",
+					    G_BUS_NAME_WATCHER_FLAGS_NONE,
+					    iio_accel_sensors_appeared, iio_accel_sensors_vanished, NULL, NULL);
+}
+
 G_MODULE_EXPORT const char *g_module_check_init(GModule * module);
 const char *g_module_check_init(GModule * module)
 {
@@ -359,6 +1105,25 @@ const char *g_module_check_init(GModule * module)
 
 	mce_log(LL_DEBUG, "Initalizing %s", MODULE_NAME);
 	mce_log(LL_INFO, "%s is a depreciated module, do not use its interfaces.", MODULE_NAME);
+
+	iio_direct_enabled = mce_conf_get_bool(MCE_CONF_IIO_ACCEL_GROUP,
+					       MCE_CONF_IIO_ACCEL_DIRECT,
+					       TRUE, NULL);
+	iio_sysfs_path = mce_conf_get_string(MCE_CONF_IIO_ACCEL_GROUP,
+					     MCE_CONF_IIO_ACCEL_SYSFS_PATH,
+					     DEFAULT_IIO_SYSFS_PATH, NULL);
+	iio_dev_path = mce_conf_get_string(MCE_CONF_IIO_ACCEL_GROUP,
+					   MCE_CONF_IIO_ACCEL_DEV_PATH,
+					   DEFAULT_IIO_DEV_PATH, NULL);
+	iio_poll_interval = mce_conf_get_int(MCE_CONF_IIO_ACCEL_GROUP,
+					     MCE_CONF_IIO_ACCEL_POLL_INTERVAL,
+					     DEFAULT_IIO_POLL_INTERVAL, NULL);
+	face_down_policy = mce_conf_get_bool(MCE_CONF_IIO_ACCEL_GROUP,
+					     MCE_CONF_IIO_ACCEL_FACE_DOWN_POLICY,
+					     FALSE, NULL);
+	face_down_delay = mce_conf_get_int(MCE_CONF_IIO_ACCEL_GROUP,
+					   MCE_CONF_IIO_ACCEL_FACE_DOWN_DELAY,
+					   DEFAULT_FACE_DOWN_DELAY, NULL);
 	
 	append_input_trigger_to_datapipe(&display_state_pipe, display_state_trigger);
 	append_output_trigger_to_datapipe(&alarm_ui_state_pipe, alarm_ui_state_trigger);
@@ -401,7 +1166,9 @@ void g_module_unload(GModule * module)
 {
 	(void)module;
 
-	remove_output_trigger_from_datapipe(&display_state_pipe, display_state_trigger);
+	remove_input_trigger_from_datapipe(&display_state_pipe, display_state_trigger);
+	remove_output_trigger_from_datapipe(&alarm_ui_state_pipe, alarm_ui_state_trigger);
+	remove_output_trigger_from_datapipe(&call_state_pipe, call_state_trigger);
 	
 	g_bus_unwatch_name(watch_id);
 	
@@ -411,6 +1178,13 @@ void g_module_unload(GModule * module)
 		iio_accel_claim_sensor(false);
 	}
 	
+	iio_direct_stop();
+	face_down_reset();
+	g_free(iio_direct_device);
+	g_free(iio_direct_chardev);
+	g_free(iio_sysfs_path);
+	g_free(iio_dev_path);
+
 	mce_dbus_owner_monitor_remove_all(&accelerometer_listeners);
 
 }
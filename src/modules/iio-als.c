@@ -21,7 +21,9 @@ static const char *const provides[] = { MODULE_PROVIDES, NULL };
 G_MODULE_EXPORT module_info_struct module_info = {
 	.name = MODULE_NAME,
 	.provides = provides,
-	.priority = 100
+	.priority = 100,
+	.active_states = MCE_STATE_MASK(MCE_STATE_USER) |
+			 MCE_STATE_MASK(MCE_STATE_BOOT)
 };
 
 static display_state_t display_state = { 0 };
@@ -37,11 +39,10 @@ static int cal_scale = 1000;
  */
 static int iio_als_get_light_value(GDBusProxy * proxy)
 {
-	(void)proxy;
 	GVariant *v;
 	GVariant *unit;
-	v = g_dbus_proxy_get_cached_property(iio_proxy, "LightLevel");
-	unit = g_dbus_proxy_get_cached_property(iio_proxy, "LightLevelUnit");
+	v = g_dbus_proxy_get_cached_property(proxy, "LightLevel");
+	unit = g_dbus_proxy_get_cached_property(proxy, "LightLevelUnit");
 	double mlux = g_variant_get_double(v)*cal_scale;
 	if (mlux < 0)
 		mlux = 0.0;
@@ -55,10 +56,12 @@ static int iio_als_get_light_value(GDBusProxy * proxy)
 
 static void iio_als_dbus_call_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
-	(void)source_object;
+	/* The call keeps its own reference to the proxy; iio_proxy
+	 * may already have been dropped by quiesce or a vanished name */
+	GDBusProxy *proxy = G_DBUS_PROXY(source_object);
 	bool claim = GPOINTER_TO_INT(user_data);
 	GError *error = NULL;
-	GVariant *ret = g_dbus_proxy_call_finish(iio_proxy, res, &error);
+	GVariant *ret = g_dbus_proxy_call_finish(proxy, res, &error);
 
 	if (!ret && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
 		mce_log(LL_WARN, "%s: failed to %s ambient light sensor %s", MODULE_NAME,
@@ -68,8 +71,8 @@ static void iio_als_dbus_call_cb(GObject *source_object, GAsyncResult *res, gpoi
 	}
 	g_clear_pointer(&ret, g_variant_unref);
 
-	if(claim) {
-		int ilux = iio_als_get_light_value(iio_proxy);
+	if (claim && proxy == iio_proxy) {
+		int ilux = iio_als_get_light_value(proxy);
 		execute_datapipe(&light_sensor_pipe, GINT_TO_POINTER(ilux), USE_INDATA, CACHE_INDATA);
 	}
 }
@@ -158,6 +161,36 @@ static void iio_als_sensors_vanished(GDBusConnection * connection, const gchar *
 	}
 }
 
+/**
+ * Release the sensor and stop watching iio-sensor-proxy
+ * while the system is in a state where the module is inactive
+ */
+G_MODULE_EXPORT void mce_module_quiesce(void);
+void mce_module_quiesce(void)
+{
+	if (watch_id != 0) {
+		g_bus_unwatch_name(watch_id);
+		watch_id = 0;
+	}
+
+	if (iio_proxy) {
+		iio_als_claim_light_sensor(false);
+		g_clear_object(&iio_proxy);
+	}
+}
+
+/**
+ * Watch iio-sensor-proxy again after mce_module_quiesce()
+ */
+G_MODULE_EXPORT void mce_module_resume(void);
+void mce_module_resume(void)
+{
+	if (watch_id == 0)
+		watch_id = g_bus_watch_name(G_BUS_TYPE_SYSTEM, "net.hadess.SensorProxy",
+					    G_BUS_NAME_WATCHER_FLAGS_NONE,
+					    iio_als_sensors_appeared, iio_als_sensors_vanished, NULL, NULL);
+}
+
 G_MODULE_EXPORT const char *g_module_check_init(GModule * module);
 const char *g_module_check_init(GModule * module)
 {
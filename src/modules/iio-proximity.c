@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "mce.h"
 #include "mce-io.h"
 #include "mce-log.h"
@@ -16,6 +19,42 @@
 
 #define MODULE_PROVIDES	"proximity"
 
+/** Name of the configuration group for this module */
+#define MCE_CONF_IIO_PROX_GROUP			"IioProximity"
+
+/** Configuration key for reading the raw kernel IIO proximity channel */
+#define MCE_CONF_IIO_PROX_RAW			"RawBackend"
+
+/** Configuration key for the IIO sysfs device directory */
+#define MCE_CONF_IIO_PROX_SYSFS_PATH		"SysfsPath"
+
+/** Configuration key for the raw poll interval */
+#define MCE_CONF_IIO_PROX_POLL_INTERVAL		"PollInterval"
+
+/** Configuration key for the raw distance above the baseline that is near */
+#define MCE_CONF_IIO_PROX_NEAR_MARGIN		"NearMargin"
+
+/** Configuration key for the raw distance above the baseline that is far */
+#define MCE_CONF_IIO_PROX_FAR_MARGIN		"FarMargin"
+
+/** Configuration key for the file the calibration is saved to */
+#define MCE_CONF_IIO_PROX_CALIBRATION_FILE	"CalibrationFile"
+
+/** Default IIO sysfs device directory */
+#define DEFAULT_IIO_SYSFS_PATH			"/sys/bus/iio/devices"
+
+/** Default raw poll interval, in milliseconds */
+#define DEFAULT_IIO_PROX_POLL_INTERVAL		100
+
+/** Default raw distance above the baseline that is near */
+#define DEFAULT_IIO_PROX_NEAR_MARGIN		100
+
+/** Default raw distance above the baseline that is far */
+#define DEFAULT_IIO_PROX_FAR_MARGIN		50
+
+/** Default file the calibration is saved to */
+#define DEFAULT_IIO_PROX_CALIBRATION_FILE	G_STRINGIFY(MCE_VAR_DIR) "/proximity-calibration"
+
 static const char *const provides[] = { MODULE_PROVIDES, NULL };
 
 G_MODULE_EXPORT module_info_struct module_info = {
@@ -29,11 +68,43 @@ static GDBusProxy *iio_proxy;
 
 static call_state_t call_state;
 static alarm_ui_state_t alarm_ui_state;
+static audio_output_t audio_output = AUDIO_OUTPUT_UNDEF;
+
+/** When the sensor was claimed, in monotonic microseconds */
+static gint64 claim_time = 0;
+/** Total time the sensor has been claimed, in microseconds */
+static gint64 claimed_total = 0;
+
+/** Open fd of the raw proximity channel, -1 if not in use */
+static int raw_fd = -1;
+static gint raw_poll_interval = DEFAULT_IIO_PROX_POLL_INTERVAL;
+static gint raw_near_margin = DEFAULT_IIO_PROX_NEAR_MARGIN;
+static gint raw_far_margin = DEFAULT_IIO_PROX_FAR_MARGIN;
+static gchar *raw_calibration_file = NULL;
+/** Raw poll timer */
+static guint raw_poll_id = 0;
+/** Raw reading with nothing in front of the sensor, -1 if unknown */
+static gint raw_baseline = -1;
+/** Saved calibration, -1 if none */
+static gint raw_saved_baseline = -1;
+/** Lowest raw reading while the sensor was claimed, -1 if none */
+static gint raw_session_min = -1;
+/** Was something near the sensor while it was claimed? */
+static bool raw_session_near = false;
+/** Is something near the sensor? */
+static bool raw_near = false;
 
 static bool iio_prox_claim_policy(void)
 {
+	/* During a call the proximity sensor only matters while the
+	 * phone is held to the ear; when the audio output isn't known,
+	 * assume that it is
+	 */
+	bool held_to_ear = (audio_output == AUDIO_OUTPUT_EARPIECE) ||
+			   (audio_output == AUDIO_OUTPUT_UNDEF);
+
 	return (call_state == CALL_STATE_RINGING) ||
-	    (call_state == CALL_STATE_ACTIVE) ||
+	    (call_state == CALL_STATE_ACTIVE && held_to_ear) ||
 	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32) || (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32);
 }
 
@@ -47,13 +118,261 @@ static bool iio_prox_get_value(GDBusProxy * proxy)
 	return prox;
 }
 
+/**
+ * Log how long the sensor was claimed, after it has been released
+ */
+static void iio_prox_log_claim_time(void)
+{
+	gint64 on_time = g_get_monotonic_time() - claim_time;
+
+	claimed_total += on_time;
+	mce_log(LL_DEBUG, "%s: sensor was on for %" G_GINT64_FORMAT
+		" ms, %" G_GINT64_FORMAT " ms in total", MODULE_NAME,
+		on_time / 1000, claimed_total / 1000);
+}
+
+/**
+ * Find the raw proximity channel of a kernel IIO device and open it
+ *
+ * @param sysfs_path The IIO sysfs device directory
+ * @return true if a channel was found, false otherwise
+ */
+static bool iio_prox_raw_open(const gchar *const sysfs_path)
+{
+	const gchar *entry;
+	GDir *dir;
+
+	if ((dir = g_dir_open(sysfs_path, 0, NULL)) == NULL)
+		return false;
+
+	while (raw_fd == -1 && (entry = g_dir_read_name(dir)) != NULL) {
+		static const char *const channels[] = {
+			"in_proximity_raw", "in_proximity0_raw", NULL
+		};
+
+		if (g_str_has_prefix(entry, "iio:device") == FALSE)
+			continue;
+
+		for (int i = 0; raw_fd == -1 && channels[i] != NULL; i++) {
+			gchar *path = g_build_filename(sysfs_path, entry,
+						       channels[i], NULL);
+
+			if ((raw_fd = open(path, O_RDONLY)) != -1)
+				mce_log(LL_INFO, "%s: using raw proximity %s",
+					MODULE_NAME, path);
+
+			g_free(path);
+		}
+	}
+
+	errno = 0;
+	g_dir_close(dir);
+
+	return raw_fd != -1;
+}
+
+/**
+ * Read the raw proximity channel
+ *
+ * @param value Where to store the reading; higher is nearer
+ * @return true on success, false on failure
+ */
+static bool iio_prox_raw_read(gint *value)
+{
+	char buf[32];
+	ssize_t len = pread(raw_fd, buf, sizeof (buf) - 1, 0);
+	gchar *end = NULL;
+	glong raw;
+
+	if (len <= 0) {
+		mce_log(LL_WARN, "%s: can not read raw proximity; %s",
+			MODULE_NAME, g_strerror(errno));
+		errno = 0;
+		return false;
+	}
+
+	buf[len] = '\0';
+	raw = strtol(buf, &end, 10);
+
+	if (end == buf || raw < 0 || raw > G_MAXINT)
+		return false;
+
+	*value = raw;
+
+	return true;
+}
+
+/**
+ * Track the baseline and apply the hysteresis to a raw reading
+ *
+ * The baseline follows the lowest reading seen, so anything cleaner
+ * is picked up at once; dirt or a screen protector that raises it is
+ * learned from the lowest reading when the sensor is released, see
+ * iio_prox_raw_stop()
+ *
+ * @param value The raw reading
+ * @param report true to report the state even if it did not change
+ */
+static void iio_prox_raw_evaluate(const gint value, bool report)
+{
+	gint delta;
+
+	if (raw_baseline == -1 || value < raw_baseline)
+		raw_baseline = value;
+
+	delta = value - raw_baseline;
+
+	if (raw_near == false && delta >= raw_near_margin) {
+		raw_near = true;
+		report = true;
+	} else if (raw_near == true && delta <= raw_far_margin) {
+		raw_near = false;
+		report = true;
+	}
+
+	/* Near readings count too; dirt that raises the resting reading
+	 * past the near margin leaves nothing but near readings
+	 */
+	if (raw_near == true)
+		raw_session_near = true;
+
+	if (raw_session_min == -1 || value < raw_session_min)
+		raw_session_min = value;
+
+	if (report == false)
+		return;
+
+	mce_log(LL_DEBUG, "%s: proximity %s; raw %d, baseline %d",
+		MODULE_NAME, raw_near ? "near" : "far", value, raw_baseline);
+
+	execute_datapipe(&proximity_sensor_pipe,
+			 GINT_TO_POINTER(raw_near ? COVER_CLOSED : COVER_OPEN),
+			 USE_INDATA, CACHE_INDATA);
+}
+
+/**
+ * Timeout callback for polling the raw proximity channel
+ *
+ * @param data Unused
+ * @return Always returns TRUE, to keep polling
+ */
+static gboolean iio_prox_raw_poll_cb(gpointer data)
+{
+	gint value;
+
+	(void)data;
+
+	if (iio_prox_raw_read(&value) == true)
+		iio_prox_raw_evaluate(value, false);
+
+	return TRUE;
+}
+
+/**
+ * Start polling the raw proximity channel
+ */
+static void iio_prox_raw_start(void)
+{
+	gint value;
+
+	raw_session_min = -1;
+	raw_session_near = false;
+	raw_near = false;
+
+	if (iio_prox_raw_read(&value) == true)
+		iio_prox_raw_evaluate(value, true);
+
+	if (raw_poll_id == 0)
+		raw_poll_id = g_timeout_add(raw_poll_interval,
+					    iio_prox_raw_poll_cb, NULL);
+}
+
+/**
+ * Stop polling the raw proximity channel,
+ * saving the baseline seen while it was claimed as the new calibration
+ *
+ * The baseline moves to the lowest reading of the claim; the sensor
+ * may have been covered for the whole claim, so it rises by at most
+ * the far margin per claim.  Dirt that keeps the sensor near is thus
+ * learned over a few claims, while a cleaner reading lowers it at once.
+ * Without a calibration, the first reading is the baseline, which is
+ * only trusted once something has come near the sensor during the claim
+ */
+static void iio_prox_raw_stop(void)
+{
+	gint baseline = raw_session_min;
+	gchar *string;
+
+	if (raw_poll_id != 0) {
+		g_source_remove(raw_poll_id);
+		raw_poll_id = 0;
+	}
+
+	if (baseline == -1)
+		return;
+
+	if (raw_saved_baseline == -1) {
+		if (raw_session_near == false)
+			return;
+	} else if (baseline > raw_saved_baseline + raw_far_margin) {
+		baseline = raw_saved_baseline + raw_far_margin;
+	}
+
+	if (baseline == raw_saved_baseline)
+		return;
+
+	/* Start the next claim from this one's baseline */
+	raw_baseline = baseline;
+
+	string = g_strdup_printf("%d\n", raw_baseline);
+
+	if (mce_write_string_to_file(raw_calibration_file, string) == TRUE)
+		raw_saved_baseline = raw_baseline;
+
+	g_free(string);
+}
+
+/**
+ * Load the saved calibration
+ */
+static void iio_prox_raw_load_calibration(void)
+{
+	gchar *string = NULL;
+
+	if (mce_read_string_from_file(raw_calibration_file, &string) == TRUE) {
+		gchar *end = NULL;
+		glong value = strtol(string, &end, 10);
+
+		if (end != string && value >= 0 && value <= G_MAXINT) {
+			raw_baseline = raw_saved_baseline = value;
+			mce_log(LL_DEBUG, "%s: calibration %d", MODULE_NAME,
+				raw_baseline);
+		}
+	}
+
+	g_free(string);
+}
+
 static bool iio_prox_claim_sensor(bool claim)
 {
 	static bool claimed = false;
 	GError *error = NULL;
 	GVariant *ret = NULL;
 
-	if (iio_proxy) {
+	/* The raw channel is used instead of iio-sensor-proxy */
+	if (raw_fd != -1) {
+		if (claim && !claimed) {
+			mce_log(LL_DEBUG, "%s: Start raw proximity", MODULE_NAME);
+			claim_time = g_get_monotonic_time();
+			iio_prox_raw_start();
+		} else if (!claim && claimed) {
+			mce_log(LL_DEBUG, "%s: Stop raw proximity", MODULE_NAME);
+			iio_prox_raw_stop();
+			iio_prox_log_claim_time();
+			execute_datapipe(&proximity_sensor_pipe, GINT_TO_POINTER(COVER_OPEN), USE_INDATA, CACHE_INDATA);
+		}
+		claimed = claim;
+	} else if (iio_proxy) {
 		if (claim && !claimed) {
 			mce_log(LL_DEBUG, "%s: Claim proximity sensor", MODULE_NAME);
 			ret =
@@ -67,6 +386,8 @@ static bool iio_prox_claim_sensor(bool claim)
 			}
 			g_clear_pointer(&ret, g_variant_unref);
 
+			claim_time = g_get_monotonic_time();
+
 			bool prox = iio_prox_get_value(iio_proxy);
 			execute_datapipe(&proximity_sensor_pipe, GINT_TO_POINTER(prox ? COVER_CLOSED : COVER_OPEN),
 					 USE_INDATA, CACHE_INDATA);
@@ -83,6 +404,8 @@ static bool iio_prox_claim_sensor(bool claim)
 			}
 			g_clear_pointer(&ret, g_variant_unref);
 
+			iio_prox_log_claim_time();
+
 			execute_datapipe(&proximity_sensor_pipe, GINT_TO_POINTER(COVER_OPEN), USE_INDATA, CACHE_INDATA);
 		}
 		claimed = claim;
@@ -104,7 +427,7 @@ static void iio_prox_properties_changed(GDBusProxy * proxy,
 
 	g_variant_dict_init(&dict, changed_properties);
 
-	if (g_variant_dict_contains(&dict, "ProximityNear")) {
+	if (raw_fd == -1 && g_variant_dict_contains(&dict, "ProximityNear")) {
 		bool prox = iio_prox_get_value(iio_proxy);
 		execute_datapipe(&proximity_sensor_pipe, GINT_TO_POINTER(prox ? COVER_CLOSED : COVER_OPEN), USE_INDATA,
 				 CACHE_INDATA);
@@ -142,9 +465,11 @@ static void iio_sensors_vanished(GDBusConnection * connection, const gchar * nam
 	(void)connection;
 	if (iio_proxy) {
 		g_clear_object(&iio_proxy);
-		iio_proxy = NULL;
 		mce_log(LL_WARN, "%s: connection to iio_sensor_proxy lost", MODULE_NAME);
-		iio_prox_claim_sensor(false);
+
+		/* The raw channel does not depend on iio-sensor-proxy */
+		if (raw_fd == -1)
+			iio_prox_claim_sensor(false);
 	}
 }
 
@@ -162,6 +487,12 @@ static void alarm_ui_state_trigger(gconstpointer data)
 	iio_prox_claim_sensor(iio_prox_claim_policy());
 }
 
+static void audio_output_trigger(gconstpointer data)
+{
+	audio_output = GPOINTER_TO_INT(data);
+	iio_prox_claim_sensor(iio_prox_claim_policy());
+}
+
 G_MODULE_EXPORT const char *g_module_check_init(GModule * module);
 const char *g_module_check_init(GModule * module)
 {
@@ -169,11 +500,49 @@ const char *g_module_check_init(GModule * module)
 
 	mce_log(LL_DEBUG, "Initalizing %s", MODULE_NAME);
 
+	if (mce_conf_get_bool(MCE_CONF_IIO_PROX_GROUP, MCE_CONF_IIO_PROX_RAW,
+			      FALSE, NULL) == TRUE) {
+		gchar *sysfs_path =
+			mce_conf_get_string(MCE_CONF_IIO_PROX_GROUP,
+					    MCE_CONF_IIO_PROX_SYSFS_PATH,
+					    DEFAULT_IIO_SYSFS_PATH, NULL);
+
+		raw_poll_interval = mce_conf_get_int(MCE_CONF_IIO_PROX_GROUP,
+						     MCE_CONF_IIO_PROX_POLL_INTERVAL,
+						     DEFAULT_IIO_PROX_POLL_INTERVAL, NULL);
+		raw_near_margin = mce_conf_get_int(MCE_CONF_IIO_PROX_GROUP,
+						   MCE_CONF_IIO_PROX_NEAR_MARGIN,
+						   DEFAULT_IIO_PROX_NEAR_MARGIN, NULL);
+		raw_far_margin = mce_conf_get_int(MCE_CONF_IIO_PROX_GROUP,
+						  MCE_CONF_IIO_PROX_FAR_MARGIN,
+						  DEFAULT_IIO_PROX_FAR_MARGIN, NULL);
+		raw_calibration_file =
+			mce_conf_get_string(MCE_CONF_IIO_PROX_GROUP,
+					    MCE_CONF_IIO_PROX_CALIBRATION_FILE,
+					    DEFAULT_IIO_PROX_CALIBRATION_FILE, NULL);
+
+		if (raw_far_margin >= raw_near_margin)
+			raw_far_margin = raw_near_margin - 1;
+
+		if (iio_prox_raw_open(sysfs_path) == true)
+			iio_prox_raw_load_calibration();
+		else
+			mce_log(LL_WARN, "%s: no raw proximity channel; "
+				"using iio-sensor-proxy", MODULE_NAME);
+
+		g_free(sysfs_path);
+	}
+
 	append_output_trigger_to_datapipe(&call_state_pipe, call_state_trigger);
 	append_output_trigger_to_datapipe(&alarm_ui_state_pipe, alarm_ui_state_trigger);
+	append_output_trigger_to_datapipe(&audio_output_pipe, audio_output_trigger);
 
 	call_state = datapipe_get_gint(call_state_pipe);
 	alarm_ui_state = datapipe_get_gint(alarm_ui_state_pipe);
+	audio_output = datapipe_get_gint(audio_output_pipe);
+
+	if (iio_prox_claim_policy())
+		iio_prox_claim_sensor(true);
 
 	watch_id = g_bus_watch_name(G_BUS_TYPE_SYSTEM, "net.hadess.SensorProxy",
 				    G_BUS_NAME_WATCHER_FLAGS_NONE,
@@ -187,6 +556,7 @@ void g_module_unload(GModule * module)
 {
 	(void)module;
 
+	remove_output_trigger_from_datapipe(&audio_output_pipe, audio_output_trigger);
 	remove_output_trigger_from_datapipe(&alarm_ui_state_pipe, alarm_ui_state_trigger);
 	remove_output_trigger_from_datapipe(&call_state_pipe, call_state_trigger);
 
@@ -195,4 +565,12 @@ void g_module_unload(GModule * module)
 		g_clear_object(&iio_proxy);
 		iio_proxy = NULL;
 	}
+
+	if (raw_fd != -1) {
+		iio_prox_claim_sensor(false);
+		close(raw_fd);
+		raw_fd = -1;
+	}
+
+	g_free(raw_calibration_file);
 }
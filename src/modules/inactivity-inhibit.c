@@ -1,8 +1,11 @@
 #include <glib.h>
 #include <gmodule.h>
 #include <stdbool.h>
+#include <string.h>
+#include <mce/mode-names.h>
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-conf.h"
 #include "mce-dbus.h"
 #include "datapipe.h"
 
@@ -32,6 +35,106 @@ G_MODULE_EXPORT module_info_struct module_info = {
  */
 #define BLANK_PREVENT_TIMEOUT			60	/* 60 seconds */
 
+/** Name of the configuration group for this module */
+#define MCE_CONF_INHIBIT_GROUP			"InactivityInhibit"
+
+/** Configuration key for the default per-application budget */
+#define MCE_CONF_INHIBIT_DEFAULT_BUDGET		"DefaultBudget"
+
+/** Configuration key for the budget period */
+#define MCE_CONF_INHIBIT_BUDGET_PERIOD		"BudgetPeriod"
+
+/** Configuration group holding per-application budgets */
+#define MCE_CONF_INHIBIT_BUDGETS_GROUP		"InactivityInhibitBudgets"
+
+/** Default per-application budget, in seconds; 0 for unlimited */
+#define DEFAULT_INHIBIT_BUDGET			0
+
+/** Default budget period, in seconds */
+#define DEFAULT_INHIBIT_BUDGET_PERIOD		3600	/* 1 hour */
+
+/** Maximum number of monitored services holding display inhibits */
+#define MAX_MONITORED_INHIBITORS		16
+
+/** Maximum number of inhibitors, including released ones */
+#define MAX_INHIBITORS				64
+
+/** Display inhibit types */
+typedef enum {
+	/** The display may dim, but not blank */
+	INHIBIT_TYPE_DIM_ONLY = 0,
+	/** The display may neither dim nor blank */
+	INHIBIT_TYPE_NO_BLANK = 1
+} inhibit_type_t;
+
+/** Display inhibit of an application, kept for statistics once released */
+typedef struct {
+	/** Application ID */
+	gchar *app_id;
+	/** Reason of the latest request */
+	gchar *reason;
+	/** D-Bus name holding the inhibit, NULL if not in effect */
+	gchar *sender;
+	/** Requested type */
+	inhibit_type_t type;
+	/** Expiry, in monotonic microseconds; 0 if none */
+	gint64 expiry_time;
+	/** Budget in seconds per budget period; 0 if unlimited */
+	gint budget;
+	/** Start of the current screen-on stretch; 0 if not counting */
+	gint64 counting_since;
+	/** Total screen-on time attributed, in microseconds */
+	gint64 total_time;
+	/** Screen-on time in the current budget period, in microseconds */
+	gint64 period_time;
+	/** Expiry/budget timeout callback ID */
+	guint timeout_cb_id;
+} inhibitor_t;
+
+/** List of inhibitor_t */
+static GSList *inhibitors = NULL;
+
+/** List of monitored services holding display inhibits */
+static GSList *inhibitor_monitor_list = NULL;
+
+/** Settings of this module, kept up to date by mce-conf */
+typedef struct {
+	/** Default per-application budget, in seconds */
+	gint default_budget;
+	/** Budget period, in seconds */
+	gint budget_period;
+	/** Per-application budgets in seconds, keyed by application ID */
+	GHashTable *budgets;
+} inhibit_settings_t;
+
+/** Settings of this module */
+static inhibit_settings_t settings;
+
+/** Configuration keys of the settings */
+static const mce_conf_binding_t settings_bindings[] = {
+	MCE_CONF_BIND_INT(inhibit_settings_t, default_budget,
+			  MCE_CONF_INHIBIT_DEFAULT_BUDGET,
+			  DEFAULT_INHIBIT_BUDGET, 0, G_MAXINT),
+	MCE_CONF_BIND_INT(inhibit_settings_t, budget_period,
+			  MCE_CONF_INHIBIT_BUDGET_PERIOD,
+			  DEFAULT_INHIBIT_BUDGET_PERIOD, 0, G_MAXINT),
+	MCE_CONF_BIND_END
+};
+
+/** Configuration keys of the per-application budgets */
+static const mce_conf_binding_t budget_bindings[] = {
+	MCE_CONF_BIND_INT_MAP(inhibit_settings_t, budgets, 0, G_MAXINT),
+	MCE_CONF_BIND_END
+};
+
+/** Start of the current budget period, in monotonic microseconds */
+static gint64 budget_period_start = 0;
+
+/** Is a no-blank inhibit in effect? */
+static bool no_blank_inhibit = false;
+
+static void inhibitors_update(void);
+
 static GSList *blanking_pause_monitor_list = NULL;
 static guint blank_prevent_timeout_cb_id = 0;
 
@@ -148,12 +251,602 @@ static gboolean blanking_pause_req_dbus_cb(DBusMessage *const msg)
 	return status;
 }
 
+/**
+ * Get the D-Bus name of an inhibit type
+ *
+ * @param type The inhibit type
+ * @return The inhibit type string
+ */
+static const gchar *inhibit_type_to_string(inhibit_type_t type)
+{
+	return (type == INHIBIT_TYPE_NO_BLANK) ?
+		MCE_INHIBIT_NO_BLANK_STRING : MCE_INHIBIT_DIM_ONLY_STRING;
+}
+
+/**
+ * Get the budget of an application
+ *
+ * @param app_id The application ID
+ * @return The budget in seconds; 0 if unlimited
+ */
+static gint inhibitor_budget(const gchar *app_id)
+{
+	gpointer budget;
+
+	if ((settings.budgets != NULL) &&
+	    (g_hash_table_lookup_extended(settings.budgets, app_id,
+					  NULL, &budget) == TRUE))
+		return GPOINTER_TO_INT(budget);
+
+	return settings.default_budget;
+}
+
+/**
+ * Find the inhibitor of an application
+ *
+ * @param app_id The application ID
+ * @return The inhibitor, or NULL if the application has none
+ */
+static inhibitor_t *inhibitor_find(const gchar *app_id)
+{
+	for (GSList *iter = inhibitors; iter; iter = iter->next) {
+		inhibitor_t *inhibitor = iter->data;
+
+		if (strcmp(inhibitor->app_id, app_id) == 0)
+			return inhibitor;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free an inhibitor
+ *
+ * @param data The inhibitor_t to free
+ */
+static void inhibitor_free(gpointer data)
+{
+	inhibitor_t *inhibitor = data;
+
+	if (inhibitor->timeout_cb_id != 0)
+		g_source_remove(inhibitor->timeout_cb_id);
+
+	g_free(inhibitor->app_id);
+	g_free(inhibitor->reason);
+	g_free(inhibitor->sender);
+	g_free(inhibitor);
+}
+
+/**
+ * Create the inhibitor of an application; when the list is full,
+ * the statistics of the oldest released inhibitor are dropped
+ *
+ * @param app_id The application ID
+ * @return The new inhibitor, or NULL if all inhibitors are in effect
+ */
+static inhibitor_t *inhibitor_new(const gchar *app_id)
+{
+	inhibitor_t *inhibitor;
+
+	if (g_slist_length(inhibitors) >= MAX_INHIBITORS) {
+		GSList *iter;
+
+		for (iter = inhibitors; iter; iter = iter->next) {
+			inhibitor = iter->data;
+
+			if (inhibitor->sender == NULL)
+				break;
+		}
+
+		if (iter == NULL)
+			return NULL;
+
+		mce_log(LL_DEBUG, "%s: dropping statistics of %s",
+			MODULE_NAME, inhibitor->app_id);
+		inhibitors = g_slist_delete_link(inhibitors, iter);
+		inhibitor_free(inhibitor);
+	}
+
+	inhibitor = g_new0(inhibitor_t, 1);
+	inhibitor->app_id = g_strdup(app_id);
+	inhibitor->budget = inhibitor_budget(app_id);
+	inhibitors = g_slist_append(inhibitors, inhibitor);
+
+	return inhibitor;
+}
+
+/**
+ * Has the inhibitor used up its budget for the current period?
+ *
+ * @param inhibitor The inhibitor
+ * @return TRUE if the budget is exhausted, FALSE otherwise
+ */
+static gboolean inhibitor_over_budget(const inhibitor_t *inhibitor)
+{
+	return ((inhibitor->budget > 0) &&
+		(inhibitor->period_time >=
+		 (gint64)inhibitor->budget * G_USEC_PER_SEC));
+}
+
+/**
+ * Attribute the screen-on time so far to the inhibitors in effect,
+ * and start or stop counting depending on the display state
+ */
+static void inhibitors_account(void)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	gint64 now = g_get_monotonic_time();
+
+	/* Roll over to a new budget period */
+	if ((settings.budget_period > 0) &&
+	    ((now - budget_period_start) >=
+	     (gint64)settings.budget_period * G_USEC_PER_SEC)) {
+		budget_period_start = now;
+
+		for (GSList *iter = inhibitors; iter; iter = iter->next) {
+			inhibitor_t *inhibitor = iter->data;
+
+			inhibitor->period_time = 0;
+			if (inhibitor->counting_since != 0)
+				inhibitor->counting_since = now;
+		}
+	}
+
+	for (GSList *iter = inhibitors; iter; iter = iter->next) {
+		inhibitor_t *inhibitor = iter->data;
+
+		if (inhibitor->counting_since != 0) {
+			gint64 delta = now - inhibitor->counting_since;
+
+			inhibitor->total_time += delta;
+			inhibitor->period_time += delta;
+			inhibitor->counting_since = 0;
+		}
+
+		if ((inhibitor->sender != NULL) &&
+		    (display_state != MCE_DISPLAY_OFF))
+			inhibitor->counting_since = now;
+	}
+}
+
+/**
+ * Release the inhibit of an application, keeping its statistics
+ *
+ * @param inhibitor The inhibitor
+ * @param why Reason for the release, for logging
+ */
+static void inhibitor_release(inhibitor_t *inhibitor, const gchar *why)
+{
+	if (inhibitor->sender == NULL)
+		return;
+
+	gchar *sender = inhibitor->sender;
+
+	mce_log(LL_DEBUG, "%s: releasing inhibit of %s; %s",
+		MODULE_NAME, inhibitor->app_id, why);
+
+	inhibitor->sender = NULL;
+	inhibitor->expiry_time = 0;
+
+	/* Stop monitoring the sender once it holds no more inhibits */
+	for (GSList *iter = inhibitors; iter; iter = iter->next) {
+		inhibitor_t *other = iter->data;
+
+		if (g_strcmp0(other->sender, sender) == 0)
+			goto EXIT;
+	}
+
+	(void)mce_dbus_owner_monitor_remove(sender, &inhibitor_monitor_list);
+
+EXIT:
+	g_free(sender);
+}
+
+/**
+ * Timeout callback for inhibit expiry and budget exhaustion
+ *
+ * @param data The inhibitor_t
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean inhibitor_timeout_cb(gpointer data)
+{
+	inhibitor_t *inhibitor = data;
+
+	inhibitor->timeout_cb_id = 0;
+
+	inhibitors_update();
+
+	return FALSE;
+}
+
+/**
+ * Reschedule the expiry/budget timeout of an inhibitor
+ *
+ * @param inhibitor The inhibitor
+ * @param now The current monotonic time
+ */
+static void inhibitor_reschedule(inhibitor_t *inhibitor, gint64 now)
+{
+	gint64 delay = -1;
+
+	if (inhibitor->timeout_cb_id != 0) {
+		g_source_remove(inhibitor->timeout_cb_id);
+		inhibitor->timeout_cb_id = 0;
+	}
+
+	if (inhibitor->sender == NULL)
+		return;
+
+	if (inhibitor->expiry_time != 0)
+		delay = inhibitor->expiry_time - now;
+
+	if ((inhibitor->budget > 0) && (inhibitor->counting_since != 0)) {
+		gint64 left = (gint64)inhibitor->budget * G_USEC_PER_SEC -
+			      inhibitor->period_time;
+
+		if ((delay < 0) || (left < delay))
+			delay = left;
+	}
+
+	if (delay >= 0)
+		inhibitor->timeout_cb_id =
+			g_timeout_add((guint)(delay / 1000) + 1,
+				      inhibitor_timeout_cb, inhibitor);
+}
+
+/**
+ * Re-evaluate all inhibitors and apply the combined inhibit
+ */
+static void inhibitors_update(void)
+{
+	bool no_blank = false;
+	bool dim_only = false;
+	gint64 now;
+
+	inhibitors_account();
+	now = g_get_monotonic_time();
+
+	for (GSList *iter = inhibitors; iter; iter = iter->next) {
+		inhibitor_t *inhibitor = iter->data;
+
+		if ((inhibitor->sender != NULL) &&
+		    (inhibitor->expiry_time != 0) &&
+		    (inhibitor->expiry_time <= now))
+			inhibitor_release(inhibitor, "expired");
+
+		if ((inhibitor->sender != NULL) &&
+		    (inhibitor_over_budget(inhibitor) == TRUE)) {
+			mce_log(LL_WARN,
+				"%s: %s has used up its budget of %d s "
+				"screen-on time", MODULE_NAME,
+				inhibitor->app_id, inhibitor->budget);
+			inhibitor_release(inhibitor, "over budget");
+		}
+
+		if (inhibitor->sender == NULL) {
+			inhibitor->counting_since = 0;
+		} else if (inhibitor->type == INHIBIT_TYPE_NO_BLANK) {
+			no_blank = true;
+		} else {
+			dim_only = true;
+		}
+
+		inhibitor_reschedule(inhibitor, now);
+	}
+
+	if (datapipe_get_gint(blank_inhibit_pipe) != dim_only)
+		execute_datapipe(&blank_inhibit_pipe,
+				 GINT_TO_POINTER(dim_only),
+				 USE_INDATA, CACHE_INDATA);
+
+	if (no_blank_inhibit != no_blank) {
+		no_blank_inhibit = no_blank;
+
+		/* Restart the inactivity timeouts */
+		execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
+				 USE_INDATA, CACHE_INDATA);
+	}
+}
+
+/**
+ * D-Bus callback used for monitoring the processes holding
+ * display inhibits; if such a process exits, release its inhibits
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean inhibitor_owner_monitor_dbus_cb(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+	const gchar *old_name;
+	const gchar *new_name;
+	const gchar *service;
+	DBusError error;
+
+	/* Register error channel */
+	dbus_error_init(&error);
+
+	/* Extract result */
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &service,
+				  DBUS_TYPE_STRING, &old_name,
+				  DBUS_TYPE_STRING, &new_name,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_ERR,
+			"%s: Failed to get argument from %s.%s; %s", MODULE_NAME,
+			"org.freedesktop.DBus", "NameOwnerChanged",
+			error.message);
+		dbus_error_free(&error);
+		return status;
+	}
+
+	/* Releasing the last inhibit also removes the owner monitor */
+	for (GSList *iter = inhibitors; iter; iter = iter->next) {
+		inhibitor_t *inhibitor = iter->data;
+
+		if (g_strcmp0(inhibitor->sender, old_name) == 0)
+			inhibitor_release(inhibitor, "owner exited");
+	}
+
+	inhibitors_update();
+
+	status = TRUE;
+
+	return status;
+}
+
+/**
+ * D-Bus callback for the display inhibit method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean display_inhibit_req_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	const gchar *sender = dbus_message_get_sender(msg);
+	const gchar *app_id = NULL;
+	const gchar *reason = NULL;
+	const gchar *type = NULL;
+	dbus_uint32_t timeout = 0;
+	dbus_bool_t granted = FALSE;
+	inhibitor_t *inhibitor;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &app_id,
+				  DBUS_TYPE_STRING, &reason,
+				  DBUS_TYPE_STRING, &type,
+				  DBUS_TYPE_UINT32, &timeout,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"%s: Failed to get argument from %s.%s: %s",
+			MODULE_NAME, MCE_REQUEST_IF, MCE_DISPLAY_INHIBIT_REQ,
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	if (sender == NULL) {
+		mce_log(LL_ERR, "%s: No sender in display inhibit request",
+			MODULE_NAME);
+		goto EXIT;
+	}
+
+	mce_log(LL_DEBUG, "%s: %s (%s) requests %s inhibit for %u s: %s",
+		MODULE_NAME, app_id, sender, type, timeout, reason);
+
+	inhibitors_account();
+
+	if (((inhibitor = inhibitor_find(app_id)) == NULL) &&
+	    ((inhibitor = inhibitor_new(app_id)) == NULL)) {
+		mce_log(LL_WARN, "%s: refusing inhibit of %s; "
+			"too many inhibitors", MODULE_NAME, app_id);
+		goto REPLY;
+	}
+
+	/* Another client cannot take over an inhibit in effect */
+	if ((inhibitor->sender != NULL) &&
+	    (strcmp(inhibitor->sender, sender) != 0)) {
+		mce_log(LL_WARN, "%s: refusing inhibit of %s from %s; "
+			"held by %s", MODULE_NAME, app_id, sender,
+			inhibitor->sender);
+		goto REPLY;
+	}
+
+	if (inhibitor_over_budget(inhibitor) == TRUE) {
+		mce_log(LL_WARN, "%s: refusing inhibit of %s; over budget",
+			MODULE_NAME, app_id);
+		goto REPLY;
+	}
+
+	if (mce_dbus_owner_monitor_add(sender,
+				       inhibitor_owner_monitor_dbus_cb,
+				       &inhibitor_monitor_list,
+				       MAX_MONITORED_INHIBITORS) == -1) {
+		mce_log(LL_WARN,
+			"%s: Failed to add name owner monitoring for `%s'; "
+			"refusing inhibit", MODULE_NAME, sender);
+		goto REPLY;
+	}
+
+	g_free(inhibitor->reason);
+	inhibitor->reason = g_strdup(reason);
+	if (inhibitor->sender == NULL)
+		inhibitor->sender = g_strdup(sender);
+	inhibitor->type = (g_strcmp0(type, MCE_INHIBIT_NO_BLANK_STRING) == 0) ?
+			  INHIBIT_TYPE_NO_BLANK : INHIBIT_TYPE_DIM_ONLY;
+	inhibitor->expiry_time = (timeout != 0) ?
+		g_get_monotonic_time() + (gint64)timeout * G_USEC_PER_SEC : 0;
+	granted = TRUE;
+
+REPLY:
+	inhibitors_update();
+
+	if (no_reply == FALSE) {
+		DBusMessage *reply = dbus_new_method_reply(msg);
+
+		if (dbus_message_append_args(reply,
+					     DBUS_TYPE_BOOLEAN, &granted,
+					     DBUS_TYPE_INVALID) == FALSE) {
+			mce_log(LL_ERR, "%s: Failed to append dbus arguments",
+				MODULE_NAME);
+			dbus_message_unref(reply);
+			goto EXIT;
+		}
+
+		status = dbus_send_message(reply);
+	} else {
+		status = TRUE;
+	}
+
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for the display inhibit cancel method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean display_inhibit_cancel_req_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	const gchar *sender = dbus_message_get_sender(msg);
+	const gchar *app_id = NULL;
+	inhibitor_t *inhibitor;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &app_id,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"%s: Failed to get argument from %s.%s: %s",
+			MODULE_NAME, MCE_REQUEST_IF,
+			MCE_DISPLAY_INHIBIT_CANCEL_REQ, error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	/* Only the holder can cancel an inhibit */
+	if (((inhibitor = inhibitor_find(app_id)) != NULL) &&
+	    (g_strcmp0(inhibitor->sender, sender) == 0)) {
+		inhibitors_account();
+		inhibitor_release(inhibitor, "cancelled");
+		inhibitors_update();
+	}
+
+	if (no_reply == FALSE) {
+		DBusMessage *reply = dbus_new_method_reply(msg);
+
+		status = dbus_send_message(reply);
+	} else {
+		status = TRUE;
+	}
+
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for the get display inhibitors method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean display_inhibitors_get_dbus_cb(DBusMessage *const msg)
+{
+	DBusMessage *reply = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	gboolean status = FALSE;
+
+	mce_log(LL_DEBUG, "%s: Received display inhibitors get request",
+		MODULE_NAME);
+
+	/* Bring the screen-on times up to date */
+	inhibitors_account();
+
+	reply = dbus_new_method_reply(msg);
+	dbus_message_iter_init_append(reply, &iter);
+
+	if (dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					     "(sssbxxi)", &array) == FALSE)
+		goto ERROR;
+
+	for (GSList *item = inhibitors; item; item = item->next) {
+		inhibitor_t *inhibitor = item->data;
+		const gchar *reason = inhibitor->reason ? inhibitor->reason : "";
+		const gchar *type = inhibit_type_to_string(inhibitor->type);
+		dbus_bool_t active = (inhibitor->sender != NULL);
+		dbus_int64_t total = inhibitor->total_time / 1000;
+		dbus_int64_t period = inhibitor->period_time / 1000;
+		dbus_int32_t budget = inhibitor->budget;
+		DBusMessageIter entry;
+
+		if ((dbus_message_iter_open_container(&array,
+						      DBUS_TYPE_STRUCT,
+						      NULL, &entry) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						    &inhibitor->app_id) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						    &reason) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING,
+						    &type) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN,
+						    &active) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT64,
+						    &total) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT64,
+						    &period) == FALSE) ||
+		    (dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32,
+						    &budget) == FALSE) ||
+		    (dbus_message_iter_close_container(&array,
+						       &entry) == FALSE))
+			goto ERROR;
+	}
+
+	if (dbus_message_iter_close_container(&iter, &array) == FALSE)
+		goto ERROR;
+
+	status = dbus_send_message(reply);
+	goto EXIT;
+
+ERROR:
+	mce_log(LL_ERR, "%s: Failed to append dbus arguments", MODULE_NAME);
+	dbus_message_unref(reply);
+
+EXIT:
+	return status;
+}
+
+/**
+ * Handle display state change
+ *
+ * @param data Unused
+ */
+static void display_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	/* Screen-on time is only attributed while the display is lit */
+	inhibitors_update();
+}
+
 static gpointer device_inactive_filter(gpointer data)
 {
 	gboolean device_inactive = GPOINTER_TO_INT(data);
 	display_state_t display_state = datapipe_get_gint(display_state_pipe);
 	
-	if (device_inactive && timed_inhibit && display_state != MCE_DISPLAY_OFF) {
+	if (device_inactive && (timed_inhibit || no_blank_inhibit) &&
+	    display_state != MCE_DISPLAY_OFF) {
 		mce_log(LL_DEBUG,
 		"%s: Device inactive state preventedby %s", MODULE_NAME, MODULE_NAME);
 		return GINT_TO_POINTER(FALSE);
@@ -176,9 +869,16 @@ const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	mce_conf_bind(MCE_CONF_INHIBIT_GROUP, settings_bindings, &settings);
+	mce_conf_bind(MCE_CONF_INHIBIT_BUDGETS_GROUP, budget_bindings,
+		      &settings);
+	budget_period_start = g_get_monotonic_time();
+
 	/* Append triggers/filters to datapipes */
 	append_filter_to_datapipe(&device_inactive_pipe,
 				  device_inactive_filter);
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  display_state_trigger);
 	
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
 				MCE_PREVENT_BLANK_REQ,
@@ -186,7 +886,30 @@ const gchar *g_module_check_init(GModule *module)
 				DBUS_MESSAGE_TYPE_METHOD_CALL,
 				blanking_pause_req_dbus_cb) == NULL)
 		return NULL;
-	
+
+	/* req_display_inhibit */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DISPLAY_INHIBIT_REQ,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 display_inhibit_req_dbus_cb) == NULL)
+		return NULL;
+
+	/* req_display_inhibit_cancel */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DISPLAY_INHIBIT_CANCEL_REQ,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 display_inhibit_cancel_req_dbus_cb) == NULL)
+		return NULL;
+
+	/* get_display_inhibitors */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_DISPLAY_INHIBITORS_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 display_inhibitors_get_dbus_cb) == NULL)
+		return NULL;
 	
 	return NULL;
 }
@@ -204,11 +927,22 @@ void g_module_unload(GModule *module)
 	(void)module;
 
 	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    display_state_trigger);
 	remove_filter_from_datapipe(&device_inactive_pipe,
 				    device_inactive_filter);
 
 	/* Remove all timer sources */
 	cancel_blank_prevent();
 
+	mce_dbus_owner_monitor_remove_all(&inhibitor_monitor_list);
+	g_slist_free_full(inhibitors, inhibitor_free);
+	inhibitors = NULL;
+
+	execute_datapipe(&blank_inhibit_pipe, GINT_TO_POINTER(FALSE),
+			 USE_INDATA, CACHE_INDATA);
+
+	mce_conf_unbind(&settings);
+
 	return;
 }
@@ -85,12 +85,17 @@ static guint inactivity_inhibit_gconf_cb_id = 0;
 
 static gint inactivity_timeout = DEFAULT_TIMEOUT;
 
+/** Cached result of the last inhibit evaluation */
+static bool inactivity_inhibit_active = false;
+
+static void setup_inactivity_timeout(void);
+static void cancel_inactivity_timeout(void);
+
 /**
- * Enable/Disable blanking inhibit,
- * based on charger status and inhibit mode
+ * Check if inactivity should be inhibited,
+ * based on call state, charger status and inhibit mode
  *
- * @param timed_inhibit TRUE for timed inhibiting,
- *                      FALSE for triggered inhibiting
+ * @return true if inactivity is inhibited, false otherwise
  */
 static bool inactivity_inhibited(void)
 {
@@ -112,6 +117,36 @@ static bool inactivity_inhibited(void)
 	return blanking_inhibited;
 }
 
+/**
+ * Re-evaluate the inactivity inhibit state
+ *
+ * Called whenever one of the inputs of inactivity_inhibited() changes;
+ * the inactivity timeout is disarmed while inhibited and rearmed
+ * once the inhibit is lifted, so that an inhibited device
+ * does not wake up for inactivity at all
+ */
+static void update_inactivity_inhibit(void)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	bool inhibited = inactivity_inhibited();
+
+	if (inhibited == inactivity_inhibit_active)
+		goto EXIT;
+
+	inactivity_inhibit_active = inhibited;
+
+	mce_log(LL_DEBUG, "%s: inactivity %s", MODULE_NAME,
+		inhibited ? "inhibited" : "no longer inhibited");
+
+	if (inhibited == true)
+		cancel_inactivity_timeout();
+	else if (display_state != MCE_DISPLAY_OFF)
+		setup_inactivity_timeout();
+
+EXIT:
+	return;
+}
+
 /**
  * Send an inactivity status reply or signal
  *
@@ -195,9 +230,6 @@ static gboolean inactivity_timeout_cb(gpointer data)
 	(void)data;
 
 	inactivity_timeout_cb_id = 0;
-	
-	if(inactivity_inhibited())
-		return TRUE;
 
 	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(TRUE),
 			       USE_INDATA, CACHE_INDATA);
@@ -226,6 +258,12 @@ static void setup_inactivity_timeout(void)
 
 	cancel_inactivity_timeout();
 
+	/* No timeout while inactivity is inhibited;
+	 * update_inactivity_inhibit() rearms it once the inhibit is lifted
+	 */
+	if (inactivity_inhibit_active == true)
+		return;
+
 	/* Sanitise timeout */
 	if (inactivity_timeout < 0)
 		inactivity_timeout = 30;
@@ -292,6 +330,19 @@ static void inactivity_timeout_trigger(gconstpointer data)
 	setup_inactivity_timeout();
 }
 
+/**
+ * Datapipe trigger for the inputs of the inactivity inhibit;
+ * used for the charger state, call state and system state
+ *
+ * @param data Unused
+ */
+static void inactivity_inhibit_trigger(gconstpointer data)
+{
+	(void)data;
+
+	update_inactivity_inhibit();
+}
+
 /**
  * Handle display state change
  *
@@ -467,6 +518,7 @@ static gboolean inactivity_mode_set_dbus_cb(DBusMessage *const msg)
 	inactivity_inhibit_mode = tmp;
 	inactivity_mode_dbus_signal();
 	mce_rtconf_set_int(MCE_BLANKING_INHIBIT_MODE_PATH, inactivity_inhibit_mode);
+	update_inactivity_inhibit();
 	mce_log(LL_DEBUG, "%s: inactivity_inhibit_mode set to %i", MODULE_NAME, inactivity_inhibit_mode);
 
 	if (no_reply == FALSE) {
@@ -522,6 +574,7 @@ static void inactiveity_rtconf_cb(const gchar *key, guint cb_id, void *user_data
 	} else if (cb_id == inactivity_inhibit_gconf_cb_id) {
 		mce_rtconf_get_int(MCE_BLANKING_INHIBIT_MODE_PATH, &inactivity_inhibit_mode);
 		inactivity_mode_dbus_signal();
+		update_inactivity_inhibit();
 	} else {
 		mce_log(LL_WARN, "%s: Spurious rtconf value received; confused!", MODULE_NAME);
 	}
@@ -535,6 +588,18 @@ static void inactiveity_rtconf_cb(const gchar *key, guint cb_id, void *user_data
  * @param module Unused
  * @return NULL on success, a string with an error message on failure
  */
+/**
+ * Log the inactivity timeout state, for diagnostics
+ */
+G_MODULE_EXPORT void mce_module_dump(void);
+void mce_module_dump(void)
+{
+	mce_log(LL_DUMP, "  timeout %d s, inhibit mode %d%s; timer %u",
+		inactivity_timeout, inactivity_inhibit_mode,
+		inactivity_inhibit_active ? ", inhibited" : "",
+		inactivity_timeout_cb_id);
+}
+
 G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 const gchar *g_module_check_init(GModule *module)
 {
@@ -547,6 +612,12 @@ const gchar *g_module_check_init(GModule *module)
 					  inactivity_timeout_trigger);
 	append_filter_to_datapipe(&display_state_pipe,
 					display_state_filter);
+	append_output_trigger_to_datapipe(&charger_state_pipe,
+					  inactivity_inhibit_trigger);
+	append_output_trigger_to_datapipe(&call_state_pipe,
+					  inactivity_inhibit_trigger);
+	append_output_trigger_to_datapipe(&system_state_pipe,
+					  inactivity_inhibit_trigger);
 	
 	/* Since we've set a default, error handling is unnecessary */
 	mce_rtconf_get_int(MCE_DISPLAY_DIM_TIMEOUT_KEY,
@@ -608,6 +679,7 @@ const gchar *g_module_check_init(GModule *module)
 				 inactivity_mode_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	inactivity_inhibit_active = inactivity_inhibited();
 	setup_inactivity_timeout();
 
 EXIT:
@@ -633,6 +705,12 @@ void g_module_unload(GModule *module)
 					  inactivity_timeout_trigger);
 	remove_filter_from_datapipe(&display_state_pipe,
 					display_state_filter);
+	remove_output_trigger_from_datapipe(&system_state_pipe,
+					    inactivity_inhibit_trigger);
+	remove_output_trigger_from_datapipe(&call_state_pipe,
+					    inactivity_inhibit_trigger);
+	remove_output_trigger_from_datapipe(&charger_state_pipe,
+					    inactivity_inhibit_trigger);
 
 	/* Remove all timer sources */
 	cancel_inactivity_timeout();
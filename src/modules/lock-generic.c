@@ -29,6 +29,7 @@ int autolock_timeout = 10;
 bool autolock = true;
 bool unlock_on_slide = false;
 bool slidelock = false;
+bool lidlock = true;
 static guint autolock_cb_id = 0;
 
 char *lock_command = NULL;
@@ -133,6 +134,22 @@ static void keyboard_slide_trigger(gconstpointer data)
 	}
 }
 
+static void lid_cover_trigger(gconstpointer data)
+{
+	cover_state_t lid_cover_state = GPOINTER_TO_INT(data);
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	system_state_t system_state = datapipe_get_gint(system_state_pipe);
+
+	if (!lidlock || system_state != MCE_STATE_USER)
+		return;
+
+	if (lid_cover_state == COVER_OPEN && display_state == MCE_DISPLAY_OFF) {
+		execute_datapipe(&display_state_pipe, GINT_TO_POINTER(MCE_DISPLAY_ON),USE_INDATA, CACHE_INDATA);
+	} else if (lid_cover_state == COVER_CLOSED && display_state != MCE_DISPLAY_OFF) {
+		execute_datapipe(&display_state_pipe, GINT_TO_POINTER(MCE_DISPLAY_OFF),USE_INDATA, CACHE_INDATA);
+	}
+}
+
 /* this function dosen belong in lock, but tklock dose this so until refactor it stays here*/
 static void powerkey_trigger(gconstpointer const data)
 {
@@ -181,12 +198,14 @@ const char *g_module_check_init(GModule * module)
 	
 	autolock = mce_conf_get_bool("LockGeneric", "Autolock", true, NULL);
 	slidelock = mce_conf_get_bool("LockGeneric", "LockOnSlide", false, NULL);
+	lidlock = mce_conf_get_bool("LockGeneric", "LockOnLid", true, NULL);
 	lock_command = mce_conf_get_string("LockGeneric", "LockCommand", NULL, NULL);
 	unlock_on_slide = mce_conf_get_string("LockGeneric", "UnlockOnSlide", false, NULL);
 	
 	append_output_trigger_to_datapipe(&display_state_pipe, display_state_trigger);
 	append_output_trigger_to_datapipe(&tk_lock_pipe, tk_lock_trigger);
 	append_output_trigger_to_datapipe(&keyboard_slide_pipe, keyboard_slide_trigger);
+	append_output_trigger_to_datapipe(&lid_cover_pipe, lid_cover_trigger);
 	append_input_trigger_to_datapipe(&keypress_pipe, powerkey_trigger);
 	append_output_trigger_to_datapipe(&call_state_pipe, call_alarm_state_trigger);
 	append_output_trigger_to_datapipe(&alarm_ui_state_pipe, call_alarm_state_trigger);
@@ -202,4 +221,5 @@ void g_module_unload(GModule * module)
 	remove_output_trigger_from_datapipe(&display_state_pipe, display_state_trigger);
 	remove_output_trigger_from_datapipe(&tk_lock_pipe, tk_lock_trigger);
 	remove_output_trigger_from_datapipe(&keyboard_slide_pipe, keyboard_slide_trigger);
+	remove_output_trigger_from_datapipe(&lid_cover_pipe, lid_cover_trigger);
 }
@@ -351,71 +351,125 @@ EXIT:
 	return;
 }
 
+/** Touchscreen policy input: system state */
+#define TS_POLICY_INPUT_SYSTEM_STATE	(1 << 0)
+/** Touchscreen policy input: lid cover state */
+#define TS_POLICY_INPUT_LID_COVER	(1 << 1)
+/** Touchscreen policy input: alarm UI state */
+#define TS_POLICY_INPUT_ALARM_UI	(1 << 2)
+/** Touchscreen policy input: submode */
+#define TS_POLICY_INPUT_SUBMODE		(1 << 3)
+/** Touchscreen policy input: display state */
+#define TS_POLICY_INPUT_DISPLAY_STATE	(1 << 4)
+/** Touchscreen policy input: tklock UI state */
+#define TS_POLICY_INPUT_TKLOCK_UI	(1 << 5)
+
+/** Decision taken by a touchscreen policy */
+typedef enum {
+	/** Leave the touchscreen as it is */
+	TS_POLICY_KEEP = 0,
+	/** Enable touchscreen events */
+	TS_POLICY_ENABLE = 1,
+	/** Disable touchscreen events */
+	TS_POLICY_DISABLE = 2
+} ts_policy_decision_t;
+
+/**
+ * A touchscreen policy; the decision is cached
+ * until one of the declared inputs changes
+ */
+typedef struct {
+	/** Name of the policy, for logging */
+	const gchar *const name;
+	/** Mask of TS_POLICY_INPUT_* the decision depends on */
+	const guint inputs;
+	/** Evaluate the decision from the current inputs */
+	ts_policy_decision_t (*const evaluate)(void);
+	/** TRUE if decision is up to date */
+	gboolean valid;
+	/** Cached decision */
+	ts_policy_decision_t decision;
+} ts_policy_t;
+
+/** Number of redundant touchscreen suspend/resume requests dropped */
+static guint ts_event_control_suppressed = 0;
+
 /**
  * Enable/disable touchscreen events
  *
+ * Requests that would not change the current state
+ * are not passed on to the touchscreen suspend pipe
+ *
  * @param enable TRUE enable events, FALSE disable events
  * @return TRUE on success, FALSE on failure
  */
 static gboolean ts_event_control(gboolean enable)
 {
-	execute_datapipe(&touchscreen_suspend_pipe, GINT_TO_POINTER(!enable),
+	gboolean suspend = !enable;
+
+	if ((datapipe_get_gint(touchscreen_suspend_pipe) != 0) == suspend) {
+		ts_event_control_suppressed++;
+		mce_log(LL_DEBUG,
+			"Touchscreen events already %s; %u redundant "
+			"requests suppressed",
+			enable ? "enabled" : "disabled",
+			ts_event_control_suppressed);
+		goto EXIT;
+	}
+
+	execute_datapipe(&touchscreen_suspend_pipe, GINT_TO_POINTER(suspend),
 			USE_INDATA, CACHE_INDATA);
 
+EXIT:
 	return TRUE;
 }
 
 /**
- * Policy based enabling of touchscreen
+ * Evaluate the touchscreen enable policy
  *
- * @return TRUE on success, FALSE on failure or partial failure
+ * @return TS_POLICY_ENABLE if events should be enabled,
+ *         TS_POLICY_KEEP otherwise
  */
-static gboolean ts_enable_policy(void)
+static ts_policy_decision_t ts_enable_policy_evaluate(void)
 {
 	system_state_t system_state = datapipe_get_gint(system_state_pipe);
 	cover_state_t lid_cover_state = datapipe_get_gint(lid_cover_pipe);
 	alarm_ui_state_t alarm_ui_state =
 				datapipe_get_gint(alarm_ui_state_pipe);
-	gboolean status = FALSE;
+	ts_policy_decision_t decision = TS_POLICY_KEEP;
 
 	/* If the cover is closed, don't bother */
 	if (lid_cover_state == COVER_CLOSED)
-		goto EXIT2;
+		goto EXIT;
 
 	if ((system_state == MCE_STATE_USER) ||
 	    (alarm_ui_state == MCE_ALARM_UI_RINGING_INT32) ||
-	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32)) {
-		if (ts_event_control(TRUE) == FALSE)
-			goto EXIT;
-	}
-
-EXIT2:
-	status = TRUE;
+	    (alarm_ui_state == MCE_ALARM_UI_VISIBLE_INT32))
+		decision = TS_POLICY_ENABLE;
 
 EXIT:
-	return status;
+	return decision;
 }
 
 /**
- * Policy based disabling of touchscreen
+ * Evaluate the touchscreen disable policy
  *
- * @return TRUE on success, FALSE on failure
+ * @return TS_POLICY_DISABLE if events should be disabled,
+ *         TS_POLICY_KEEP otherwise
  */
-static gboolean ts_disable_policy(void)
+static ts_policy_decision_t ts_disable_policy_evaluate(void)
 {
 	display_state_t display_state = datapipe_get_gint(display_state_pipe);
 	system_state_t system_state = datapipe_get_gint(system_state_pipe);
 	alarm_ui_state_t alarm_ui_state =
 				datapipe_get_gint(alarm_ui_state_pipe);
 	submode_t submode = mce_get_submode_int32();
-	gboolean status = FALSE;
+	ts_policy_decision_t decision = TS_POLICY_KEEP;
 
 	/* If we're in softoff submode, always disable */
 	if ((submode & MCE_SOFTOFF_SUBMODE) != 0) {
-		if (ts_event_control(FALSE) == FALSE)
-			goto EXIT;
-
-		goto EXIT2;
+		decision = TS_POLICY_DISABLE;
+		goto EXIT;
 	}
 
 	/* If the Alarm UI is visible, don't disable,
@@ -427,32 +481,188 @@ static gboolean ts_disable_policy(void)
 		mce_log(LL_DEBUG,
 			"Alarm UI visible; refusing to disable touchscreen "
 			"and keypad events");
-		goto EXIT2;
+		goto EXIT;
 	}
 
-	if (system_state != MCE_STATE_USER)
-	{
-		if (ts_event_control(FALSE) == FALSE)
-					goto EXIT;
-	} else if((display_state == MCE_DISPLAY_OFF) && (is_tklock_enabled() == TRUE)) {
-		if (ts_event_control(FALSE) == FALSE)
-					goto EXIT;
-	} else if (is_tklock_enabled() == TRUE && disable_ts_immediately == TRUE) {
-		if (ts_event_control(FALSE) == FALSE)
-					goto EXIT;
+	if (system_state != MCE_STATE_USER) {
+		decision = TS_POLICY_DISABLE;
+	} else if ((display_state == MCE_DISPLAY_OFF) &&
+		   (is_tklock_enabled() == TRUE)) {
+		decision = TS_POLICY_DISABLE;
+	} else if ((is_tklock_enabled() == TRUE) &&
+		   (disable_ts_immediately == TRUE)) {
+		decision = TS_POLICY_DISABLE;
 	}
 
-EXIT2:
-	status = TRUE;
-
 EXIT:
+	return decision;
+}
+
+/** Policy based enabling of touchscreen */
+static ts_policy_t ts_enable_policy_data = {
+	.name = "enable",
+	.inputs = TS_POLICY_INPUT_SYSTEM_STATE |
+		  TS_POLICY_INPUT_LID_COVER |
+		  TS_POLICY_INPUT_ALARM_UI,
+	.evaluate = ts_enable_policy_evaluate,
+	.valid = FALSE,
+	.decision = TS_POLICY_KEEP
+};
+
+/** Policy based disabling of touchscreen */
+static ts_policy_t ts_disable_policy_data = {
+	.name = "disable",
+	.inputs = TS_POLICY_INPUT_SYSTEM_STATE |
+		  TS_POLICY_INPUT_ALARM_UI |
+		  TS_POLICY_INPUT_SUBMODE |
+		  TS_POLICY_INPUT_DISPLAY_STATE |
+		  TS_POLICY_INPUT_TKLOCK_UI,
+	.evaluate = ts_disable_policy_evaluate,
+	.valid = FALSE,
+	.decision = TS_POLICY_KEEP
+};
+
+/** All touchscreen policies */
+static ts_policy_t *const ts_policies[] = {
+	&ts_enable_policy_data,
+	&ts_disable_policy_data,
+	NULL
+};
+
+/**
+ * Invalidate the cached decisions of the touchscreen policies
+ * that depend on any of the given inputs
+ *
+ * @param inputs Mask of TS_POLICY_INPUT_* that have changed
+ */
+static void ts_policy_invalidate(guint inputs)
+{
+	gint i;
+
+	for (i = 0; ts_policies[i] != NULL; i++) {
+		if ((ts_policies[i]->inputs & inputs) != 0)
+			ts_policies[i]->valid = FALSE;
+	}
+}
+
+/**
+ * Apply a touchscreen policy, re-evaluating it
+ * only if its inputs have changed since the last time
+ *
+ * @param policy The policy to apply
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ts_policy_apply(ts_policy_t *policy)
+{
+	gboolean status = TRUE;
+
+	if (policy->valid == FALSE) {
+		policy->decision = policy->evaluate();
+		policy->valid = TRUE;
+	}
+
+	switch (policy->decision) {
+	case TS_POLICY_ENABLE:
+		status = ts_event_control(TRUE);
+		break;
+
+	case TS_POLICY_DISABLE:
+		status = ts_event_control(FALSE);
+		break;
+
+	case TS_POLICY_KEEP:
+	default:
+		break;
+	}
+
 	if (status == FALSE) {
-		mce_log(LL_ERR, "Failed to disable ts/kp events!");
+		mce_log(LL_ERR, "Failed to apply touchscreen %s policy",
+			policy->name);
 	}
 
 	return status;
 }
 
+/**
+ * Policy based enabling of touchscreen
+ *
+ * @return TRUE on success, FALSE on failure or partial failure
+ */
+static gboolean ts_enable_policy(void)
+{
+	return ts_policy_apply(&ts_enable_policy_data);
+}
+
+/**
+ * Policy based disabling of touchscreen
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ts_disable_policy(void)
+{
+	return ts_policy_apply(&ts_disable_policy_data);
+}
+
+/**
+ * Invalidate touchscreen policies on system state change
+ *
+ * @param data Unused
+ */
+static void ts_policy_system_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	ts_policy_invalidate(TS_POLICY_INPUT_SYSTEM_STATE);
+}
+
+/**
+ * Invalidate touchscreen policies on lid cover change
+ *
+ * @param data Unused
+ */
+static void ts_policy_lid_cover_trigger(gconstpointer data)
+{
+	(void)data;
+
+	ts_policy_invalidate(TS_POLICY_INPUT_LID_COVER);
+}
+
+/**
+ * Invalidate touchscreen policies on alarm UI state change
+ *
+ * @param data Unused
+ */
+static void ts_policy_alarm_ui_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	ts_policy_invalidate(TS_POLICY_INPUT_ALARM_UI);
+}
+
+/**
+ * Invalidate touchscreen policies on submode change
+ *
+ * @param data Unused
+ */
+static void ts_policy_submode_trigger(gconstpointer data)
+{
+	(void)data;
+
+	ts_policy_invalidate(TS_POLICY_INPUT_SUBMODE);
+}
+
+/**
+ * Invalidate touchscreen policies on display state change
+ *
+ * @param data Unused
+ */
+static void ts_policy_display_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	ts_policy_invalidate(TS_POLICY_INPUT_DISPLAY_STATE);
+}
+
 /**
  * Synthesise activity, since activity is filtered when tklock is active;
  * also, the lock key doesn't normally generate activity
@@ -617,6 +827,7 @@ static gboolean open_tklock_ui(const dbus_uint32_t mode,
 	status = TRUE;
 
 	tklock_ui_state = new_tklock_ui_state;
+	ts_policy_invalidate(TS_POLICY_INPUT_TKLOCK_UI);
 
 EXIT2:
 	dbus_message_unref(reply);
@@ -672,6 +883,7 @@ static gboolean close_tklock_ui(const dbus_bool_t silent)
 	status = TRUE;
 
 	tklock_ui_state = MCE_TKLOCK_UI_NONE;
+	ts_policy_invalidate(TS_POLICY_INPUT_TKLOCK_UI);
 
 EXIT:
 	return status;
@@ -2293,6 +2505,16 @@ const char *g_module_check_init(GModule * module)
 					 lockkey_trigger);
 	append_input_trigger_to_datapipe(&keypress_pipe,
 					 keypress_trigger);
+	append_input_trigger_to_datapipe(&system_state_pipe,
+					 ts_policy_system_state_trigger);
+	append_input_trigger_to_datapipe(&lid_cover_pipe,
+					 ts_policy_lid_cover_trigger);
+	append_input_trigger_to_datapipe(&alarm_ui_state_pipe,
+					 ts_policy_alarm_ui_state_trigger);
+	append_input_trigger_to_datapipe(&submode_pipe,
+					 ts_policy_submode_trigger);
+	append_input_trigger_to_datapipe(&display_state_pipe,
+					 ts_policy_display_state_trigger);
 	append_output_trigger_to_datapipe(&system_state_pipe,
 					  system_state_trigger);
 	append_output_trigger_to_datapipe(&display_state_pipe,
@@ -2429,6 +2651,16 @@ void g_module_unload(GModule * module)
 					    display_state_trigger);
 	remove_output_trigger_from_datapipe(&system_state_pipe,
 					    system_state_trigger);
+	remove_input_trigger_from_datapipe(&display_state_pipe,
+					   ts_policy_display_state_trigger);
+	remove_input_trigger_from_datapipe(&submode_pipe,
+					   ts_policy_submode_trigger);
+	remove_input_trigger_from_datapipe(&alarm_ui_state_pipe,
+					   ts_policy_alarm_ui_state_trigger);
+	remove_input_trigger_from_datapipe(&lid_cover_pipe,
+					   ts_policy_lid_cover_trigger);
+	remove_input_trigger_from_datapipe(&system_state_pipe,
+					   ts_policy_system_state_trigger);
 	remove_input_trigger_from_datapipe(&keypress_pipe,
 					   keypress_trigger);
 	remove_input_trigger_from_datapipe(&lockkey_pipe,
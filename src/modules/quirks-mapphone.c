@@ -3,20 +3,30 @@
  * workarounds.
  */
 #include <glib.h>
-#include <gio/gio.h>
 #include <gmodule.h>
 #include <glib/gstdio.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "mce.h"
 #include "mce-log.h"
 #include "datapipe.h"
 #include "mce-conf.h"
+#include "mce-modem.h"
 
-#define CPU1_ONLINE_PATH	"/sys/devices/system/cpu/cpu1/online"
 #define GSMTTY1_PATH 		"/dev/gsmtty1"
 
+/** Modem ports kicked to work around the modem pm bug */
+#define DEFAULT_KICK_PORTS	"/dev/ttyUSB3;/dev/ttyUSB4"
+
+/** Default time in seconds a port has to be idle before it is kicked */
+#define DEFAULT_KICK_IDLE	600
+
+/** Default time in seconds kicks may be advanced to share a wakeup */
+#define DEFAULT_KICK_SLACK	60
+
 #define MODULE_NAME		"quirks-mapphone"
 #define MODULE_PROVIDES		"quirks"
 
@@ -29,169 +39,148 @@ G_MODULE_EXPORT module_info_struct module_info = {
 };
 
 static guint kick_timeout_cb_id = 0;
+/** Modem ports to kick, NULL terminated */
+static gchar **kick_ports = NULL;
+/** Time of the last kick of each port */
+static time_t *kick_times = NULL;
+static gint kick_idle = DEFAULT_KICK_IDLE;
+static gint kick_slack = DEFAULT_KICK_SLACK;
 static display_state_t display_state;
-static bool offline_cpu;
-static GCancellable *cancellable = NULL;
+static mce_modem_channel_t *modem_channel = NULL;
 
-static void modem_close_cb(GObject *source_object, GAsyncResult *res,
-			   gpointer user_data)
+/**
+ * Kick a modem port by opening and closing it
+ *
+ * @param path The port
+ */
+static void modem_kick_port(const gchar *path)
 {
-	(void)user_data;
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
 
-	g_output_stream_close_finish(G_OUTPUT_STREAM(source_object), res, NULL);
-	g_object_unref(source_object);
+	mce_log(LL_DEBUG, "%s: Kicking %s to avoid pm bug", MODULE_NAME, path);
+
+	if (fd >= 0)
+		close(fd);
+	else
+		mce_log(LL_WARN, "%s: unable to kick %s", MODULE_NAME, path);
 }
 
-static void modem_write_cb(GObject *source_object, GAsyncResult *res,
-			   gpointer user_data)
+/**
+ * Get the time until a modem port is due a kick; the kernel updates
+ * the timestamps of a tty node when data passes through it
+ *
+ * @param i Index of the port
+ * @param now The current time
+ * @return Seconds until the port has been idle long enough,
+ *         0 if it already has, -1 if the port does not exist
+ */
+static gint64 modem_port_due_in(int i, time_t now)
 {
-	GOutputStream *os = G_OUTPUT_STREAM(source_object);
-	GError *error = NULL;
-	gsize size = g_output_stream_write_finish(os, res, &error);
-
-	if (size != GPOINTER_TO_SIZE(user_data) || error) {
-		bool is_canceled;
-
-		if (error) {
-			is_canceled = g_error_matches(error, G_IO_ERROR,
-						      G_IO_ERROR_CANCELLED);
-		} else {
-			is_canceled = FALSE;
-		}
+	struct stat st;
+	time_t last;
 
-		if (!error || !is_canceled) {
-			mce_log(LL_WARN, "%s: can not set modem state [%s]",
-				MODULE_NAME,
-				error ? error->message : "No error");
-		}
-
-		if (!is_canceled)
-			g_clear_object(&cancellable);
-	} else {
-		mce_log(LL_INFO, "%s: Modem state set", MODULE_NAME);
-		g_clear_object(&cancellable);
-	}
+	if (stat(kick_ports[i], &st) == -1)
+		return -1;
 
-	g_clear_error(&error);
-	g_output_stream_close_async(os, 0, NULL, modem_close_cb, NULL);
-}
+	last = MAX(MAX(st.st_atime, st.st_mtime), kick_times[i]);
 
-static void modem_append_cb(GObject *source_object, GAsyncResult *res,
-			    gpointer user_data)
-{
-	GError *error = NULL;
-	GFileOutputStream *os = g_file_append_to_finish(G_FILE(source_object),
-							res, &error);
-
-	if (os) {
-		display_state_t state = GPOINTER_TO_INT(user_data);
-		const char *const msg = state == MCE_DISPLAY_ON ?
-						"U1234AT+SCRN=1\r" :
-						"U1234AT+SCRN=0\r";
-		const gsize len = strlen(msg);
-
-		mce_log(LL_DEBUG, "%s: Setting modem state to SCRN=%s",
-			MODULE_NAME,
-			state == MCE_DISPLAY_ON ? "1" : "0");
-
-		g_output_stream_write_async(G_OUTPUT_STREAM(os), msg, len, 0,
-					    cancellable, modem_write_cb,
-					    GSIZE_TO_POINTER(len));
-	} else {
-		if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-			mce_log(LL_WARN, "%s: can not open "GSMTTY1_PATH" [%s]",
-				MODULE_NAME, error->message);
-			g_clear_object(&cancellable);
-		}
-	}
+	/* The wall clock may have been set back since the port was used;
+	 * don't wait for a time in the future to become idle
+	 */
+	last = MIN(last, now);
 
-	g_clear_error(&error);
+	return MAX((gint64)last + kick_idle - now, 0);
 }
 
-static void display_state_trigger(gconstpointer data)
+static gboolean inactivity_timeout_cb(gpointer data);
+
+/**
+ * Kick the ports that are due within the slack window,
+ * then schedule a wakeup for the next port to fall due;
+ * no wakeup is scheduled while none of the ports exist
+ *
+ * @param window Seconds ahead of time a port may be kicked
+ */
+static void modem_kick_schedule(gint window)
 {
-	display_state_t new_state = GPOINTER_TO_INT(data);
-	display_state_t old_state = display_state;
-	int fd;
+	time_t now = time(NULL);
+	gint64 next = -1;
 
-	if (new_state == old_state)
+	if (kick_timeout_cb_id != 0) {
+		g_source_remove(kick_timeout_cb_id);
+		kick_timeout_cb_id = 0;
+	}
+
+	if (kick_ports == NULL)
 		return;
 
-	display_state = new_state;
+	for (int i = 0; kick_ports[i] != NULL; i++) {
+		gint64 due = modem_port_due_in(i, now);
 
-	if ((new_state == MCE_DISPLAY_ON && old_state == MCE_DISPLAY_DIM) ||
-	    new_state == MCE_DISPLAY_DIM) {
-		return;
-	}
+		if (due < 0)
+			continue;
 
-	GFile *file = g_file_new_for_path(GSMTTY1_PATH);
+		if (due <= window) {
+			modem_kick_port(kick_ports[i]);
+			kick_times[i] = now;
+			due = kick_idle;
+		}
 
-	if (cancellable) {
-		g_cancellable_cancel(cancellable);
-		g_object_unref(cancellable);
+		if (next < 0 || due < next)
+			next = due;
 	}
 
-	cancellable = g_cancellable_new();
+	if (next < 0) {
+		mce_log(LL_DEBUG, "%s: no modem ports; not kicking",
+			MODULE_NAME);
+		return;
+	}
 
-	g_file_append_to_async(file, G_FILE_CREATE_NONE, 0, cancellable,
-			       modem_append_cb, GINT_TO_POINTER(display_state));
-	g_object_unref(file);
+	kick_timeout_cb_id = g_timeout_add_seconds(MAX(next, 1),
+						   inactivity_timeout_cb,
+						   NULL);
+}
 
-	if (offline_cpu) {
-		fd = open(CPU1_ONLINE_PATH, O_WRONLY);
+static gboolean inactivity_timeout_cb(gpointer data)
+{
+	(void)data;
 
-		if (fd < 0) {
-			mce_log(LL_WARN, "%s: can not open "
-				CPU1_ONLINE_PATH, MODULE_NAME);
-		} else {
-			if (display_state == MCE_DISPLAY_ON) {
-				const char *const msg = "1";
+	kick_timeout_cb_id = 0;
 
-				mce_log(LL_DEBUG, "%s: Turning on cpu1",
-					MODULE_NAME);
+	/* Kick every port due soon, so they share this wakeup */
+	modem_kick_schedule(kick_slack);
 
-				if (write(fd, msg, strlen(msg)) < 0) {
-					mce_log(LL_WARN,
-						"%s: can not turn on cpu1",
-						MODULE_NAME);
-				}
-			} else {
-				const char *const msg = "0";
+	return FALSE;
+}
 
-				mce_log(LL_DEBUG, "%s: Turning off cpu1",
-					MODULE_NAME);
+static void display_state_trigger(gconstpointer data)
+{
+	display_state_t new_state = GPOINTER_TO_INT(data);
+	display_state_t old_state = display_state;
 
-				if (write(fd, msg, strlen(msg)) < 0) {
-					mce_log(LL_WARN,
-						"%s: can not turn off cpu1",
-						MODULE_NAME);
-				}
-			}
+	if (new_state == old_state)
+		return;
 
-			close(fd);
-		}
-	}
-}
+	display_state = new_state;
 
-static gboolean inactivity_timeout_cb(gpointer data)
-{
-	(void)data;
+	/* The device is awake anyway; kick ports that are due soon,
+	 * and notice ports that appeared or disappeared
+	 */
+	if (new_state == MCE_DISPLAY_ON)
+		modem_kick_schedule(kick_slack);
 
-	mce_log(LL_DEBUG, "%s: Kicking modem to avoid pm bug", MODULE_NAME);
+	if ((new_state == MCE_DISPLAY_ON && old_state == MCE_DISPLAY_DIM) ||
+	    new_state == MCE_DISPLAY_DIM) {
+		return;
+	}
 
-	int fdUSB3 = open("/dev/ttyUSB3", O_RDWR);
-	int fdUSB4 = open("/dev/ttyUSB4", O_RDWR);
-	
-	if (fdUSB3 >= 0)
-		close(fdUSB3);
-	else
-		mce_log(LL_WARN, "%s: unable to kick ttyUSB3", MODULE_NAME);
-	if (fdUSB4 >= 0)
-		close(fdUSB4);
-	else
-		mce_log(LL_WARN, "%s: unable to kick ttyUSB4", MODULE_NAME);
+	mce_log(LL_DEBUG, "%s: Setting modem state to SCRN=%s",
+		MODULE_NAME, display_state == MCE_DISPLAY_ON ? "1" : "0");
 
-	return TRUE;
+	/* Rapid on/off changes collapse into the final state */
+	mce_modem_channel_set_hint(modem_channel, "SCRN",
+				   display_state == MCE_DISPLAY_ON ?
+				   "U1234AT+SCRN=1\r" : "U1234AT+SCRN=0\r");
 }
 
 G_MODULE_EXPORT const char *g_module_check_init(GModule * module);
@@ -201,13 +190,24 @@ const char *g_module_check_init(GModule * module)
 
 	mce_log(LL_DEBUG, "Initalizing %s", MODULE_NAME);
 
+	modem_channel = mce_modem_channel_new(GSMTTY1_PATH);
+
 	display_state = datapipe_get_gint(display_state_pipe);
 	append_output_trigger_to_datapipe(&display_state_pipe, display_state_trigger);
 
-	kick_timeout_cb_id = g_timeout_add_seconds(600, inactivity_timeout_cb, NULL);
-	inactivity_timeout_cb(NULL);
+	kick_idle = mce_conf_get_int("QuirksMapphone", "KickIdle",
+				     DEFAULT_KICK_IDLE, NULL);
+	kick_slack = mce_conf_get_int("QuirksMapphone", "KickSlack",
+				      DEFAULT_KICK_SLACK, NULL);
+	kick_ports = mce_conf_get_string_list("QuirksMapphone", "KickPorts",
+					      NULL, NULL);
+
+	if (kick_ports == NULL)
+		kick_ports = g_strsplit(DEFAULT_KICK_PORTS, ";", -1);
+
+	kick_times = g_new0(time_t, g_strv_length(kick_ports));
 
-	offline_cpu = mce_conf_get_bool("QuirksMapphone", "OfflineCpu", true, NULL);
+	modem_kick_schedule(0);
 
 	return NULL;
 }
@@ -219,7 +219,17 @@ void g_module_unload(GModule * module)
 
 	remove_output_trigger_from_datapipe(&display_state_pipe, display_state_trigger);
 
+	if (kick_timeout_cb_id != 0) {
+		g_source_remove(kick_timeout_cb_id);
+		kick_timeout_cb_id = 0;
+	}
+
+	g_strfreev(kick_ports);
+	kick_ports = NULL;
+	g_free(kick_times);
+
 	display_state_trigger(GINT_TO_POINTER(MCE_DISPLAY_ON));
 
-	g_source_remove(kick_timeout_cb_id);
+	mce_modem_channel_free(modem_channel);
+	modem_channel = NULL;
 }
@@ -0,0 +1,489 @@
+/* This module switches the power of wayland outputs in step with
+ * the display state, using the wlr-output-power-management protocol.
+ * It is the wayland counterpart of x11-ctrl: with the outputs
+ * powered off the compositor stops producing frames for them.
+ */
+#include <glib.h>
+#include <gmodule.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wayland-client.h>
+
+#include "wlr-output-power-management-unstable-v1-client-protocol.h"
+
+#include "mce-log.h"
+#include "mce-conf.h"
+#include "mce.h"
+#include "datapipe.h"
+
+/** Module name */
+#define MODULE_NAME		"wayland-ctrl"
+
+/** Name of the configuration group for this module */
+#define MCE_CONF_WAYLAND_CTRL_GROUP	"WaylandCtrl"
+
+/** Name of the configuration key for the compositor socket */
+#define MCE_CONF_WAYLAND_CTRL_SOCKET	"Socket"
+
+/** First delay in seconds before retrying to connect to the compositor */
+#define WL_CTRL_RETRY_MIN		1
+
+/** Longest delay in seconds between connection attempts */
+#define WL_CTRL_RETRY_MAX		64
+
+/** Functionality provided by this module */
+static const gchar *const provides[] = { MODULE_NAME, NULL };
+
+/** Module information */
+G_MODULE_EXPORT module_info_struct module_info = {
+	/** Name of the module */
+	.name = MODULE_NAME,
+	/** Module provides */
+	.provides = provides,
+	/** Module priority */
+	.priority = 250
+};
+
+/** A wayland output and its power control */
+struct wl_ctrl_output {
+	/** Registry name of the output global */
+	uint32_t name;
+	/** The bound output */
+	struct wl_output *output;
+	/** Power control for the output, NULL if unavailable */
+	struct zwlr_output_power_v1 *power;
+};
+
+/** Persistent connection to the compositor */
+static struct wl_display *wl_dpy = NULL;
+static struct wl_registry *wl_reg = NULL;
+static struct zwlr_output_power_manager_v1 *power_manager = NULL;
+/** List of struct wl_ctrl_output */
+static GSList *outputs = NULL;
+/** I/O watch for the compositor connection */
+static guint wl_watch_id = 0;
+/** I/O watch for finishing a flush the socket could not take at once */
+static guint wl_flush_watch_id = 0;
+/** Pending sync marking the end of the initial globals */
+static struct wl_callback *wl_sync = NULL;
+/** Timeout for retrying the connection */
+static guint wl_retry_id = 0;
+/** Delay in seconds before the next connection attempt */
+static guint wl_retry_delay = WL_CTRL_RETRY_MIN;
+
+/** Compositor socket name or path, NULL to use WAYLAND_DISPLAY */
+static gchar *wl_socket = NULL;
+
+/** The power mode outputs should be in */
+static bool outputs_on = true;
+
+static void wl_ctrl_disconnect(void);
+static void wl_ctrl_schedule_retry(void);
+static bool wl_ctrl_flush(void);
+
+static void output_power_mode_cb(void *data,
+				 struct zwlr_output_power_v1 *power,
+				 uint32_t mode)
+{
+	struct wl_ctrl_output *out = data;
+
+	(void)power;
+
+	mce_log(LL_DEBUG, "%s: output %u is now %s", MODULE_NAME, out->name,
+		mode == ZWLR_OUTPUT_POWER_V1_MODE_ON ? "on" : "off");
+}
+
+static void output_power_failed_cb(void *data,
+				   struct zwlr_output_power_v1 *power)
+{
+	struct wl_ctrl_output *out = data;
+
+	mce_log(LL_WARN, "%s: power control for output %u failed",
+		MODULE_NAME, out->name);
+
+	zwlr_output_power_v1_destroy(power);
+	out->power = NULL;
+}
+
+static const struct zwlr_output_power_v1_listener output_power_listener = {
+	.mode = output_power_mode_cb,
+	.failed = output_power_failed_cb,
+};
+
+static void wl_ctrl_output_set_mode(struct wl_ctrl_output *out)
+{
+	if (out->power == NULL)
+		return;
+
+	zwlr_output_power_v1_set_mode(out->power, outputs_on ?
+				      ZWLR_OUTPUT_POWER_V1_MODE_ON :
+				      ZWLR_OUTPUT_POWER_V1_MODE_OFF);
+}
+
+static void wl_ctrl_output_get_power(struct wl_ctrl_output *out)
+{
+	if (power_manager == NULL || out->power != NULL)
+		return;
+
+	out->power = zwlr_output_power_manager_v1_get_output_power(power_manager,
+								   out->output);
+	zwlr_output_power_v1_add_listener(out->power, &output_power_listener, out);
+
+	/* Hotplugged outputs follow the current display state */
+	wl_ctrl_output_set_mode(out);
+}
+
+static void wl_ctrl_output_free(gpointer data)
+{
+	struct wl_ctrl_output *out = data;
+
+	if (out->power != NULL)
+		zwlr_output_power_v1_destroy(out->power);
+	wl_output_destroy(out->output);
+	g_free(out);
+}
+
+static void registry_global_cb(void *data, struct wl_registry *registry,
+			       uint32_t name, const char *interface,
+			       uint32_t version)
+{
+	(void)data;
+	(void)version;
+
+	if (strcmp(interface, wl_output_interface.name) == 0) {
+		struct wl_ctrl_output *out = g_new0(struct wl_ctrl_output, 1);
+
+		out->name = name;
+		out->output = wl_registry_bind(registry, name,
+					       &wl_output_interface, 1);
+		outputs = g_slist_append(outputs, out);
+
+		wl_ctrl_output_get_power(out);
+	} else if (strcmp(interface,
+			  zwlr_output_power_manager_v1_interface.name) == 0) {
+		power_manager =
+			wl_registry_bind(registry, name,
+					 &zwlr_output_power_manager_v1_interface, 1);
+
+		for (GSList *iter = outputs; iter; iter = iter->next)
+			wl_ctrl_output_get_power(iter->data);
+	}
+}
+
+static void registry_global_remove_cb(void *data,
+				      struct wl_registry *registry,
+				      uint32_t name)
+{
+	(void)data;
+	(void)registry;
+
+	for (GSList *iter = outputs; iter; iter = iter->next) {
+		struct wl_ctrl_output *out = iter->data;
+
+		if (out->name == name) {
+			outputs = g_slist_delete_link(outputs, iter);
+			wl_ctrl_output_free(out);
+			break;
+		}
+	}
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_global_cb,
+	.global_remove = registry_global_remove_cb,
+};
+
+static void registry_sync_done_cb(void *data, struct wl_callback *callback,
+				  uint32_t serial)
+{
+	(void)data;
+	(void)serial;
+
+	wl_callback_destroy(callback);
+	wl_sync = NULL;
+
+	/* The connection works; start over with short retries */
+	wl_retry_delay = WL_CTRL_RETRY_MIN;
+
+	if (power_manager == NULL)
+		mce_log(LL_WARN, "%s: compositor does not support %s",
+			MODULE_NAME, zwlr_output_power_manager_v1_interface.name);
+}
+
+static const struct wl_callback_listener registry_sync_listener = {
+	.done = registry_sync_done_cb,
+};
+
+/**
+ * I/O callback for finishing a flush once the socket is writable
+ *
+ * @param source Unused
+ * @param condition Unused
+ * @param data Unused
+ * @return Always returns FALSE, to remove the watch
+ */
+static gboolean wl_ctrl_flush_cb(GIOChannel *source, GIOCondition condition,
+				 gpointer data)
+{
+	(void)source;
+	(void)condition;
+	(void)data;
+
+	wl_flush_watch_id = 0;
+
+	if (wl_ctrl_flush() == false) {
+		mce_log(LL_WARN, "%s: unable to flush requests to compositor",
+			MODULE_NAME);
+		wl_ctrl_disconnect();
+		wl_ctrl_schedule_retry();
+	}
+
+	return FALSE;
+}
+
+/**
+ * Send the queued requests to the compositor; whatever the socket
+ * cannot take at once is sent once it is writable again
+ *
+ * @return true if the requests were or will be sent,
+ *         false if the connection failed
+ */
+static bool wl_ctrl_flush(void)
+{
+	GIOChannel *channel;
+
+	/* The requests go out with the pending flush */
+	if (wl_flush_watch_id != 0)
+		return true;
+
+	errno = 0;
+
+	if (wl_display_flush(wl_dpy) >= 0)
+		return true;
+
+	if (errno != EAGAIN) {
+		errno = 0;
+		return false;
+	}
+
+	errno = 0;
+
+	channel = g_io_channel_unix_new(wl_display_get_fd(wl_dpy));
+	wl_flush_watch_id = g_io_add_watch(channel, G_IO_OUT,
+					   wl_ctrl_flush_cb, NULL);
+	g_io_channel_unref(channel);
+
+	return true;
+}
+
+static gboolean wl_ctrl_io_cb(GIOChannel *source, GIOCondition condition,
+			      gpointer data)
+{
+	(void)source;
+	(void)data;
+
+	/* Dispatching may queue requests, such as for new outputs */
+	if ((condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) != 0 ||
+	    wl_display_dispatch(wl_dpy) < 0 ||
+	    wl_ctrl_flush() == false) {
+		mce_log(LL_WARN, "%s: lost connection to compositor",
+			MODULE_NAME);
+		wl_watch_id = 0;
+		wl_ctrl_disconnect();
+		wl_ctrl_schedule_retry();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void wl_ctrl_disconnect(void)
+{
+	if (wl_watch_id != 0) {
+		g_source_remove(wl_watch_id);
+		wl_watch_id = 0;
+	}
+
+	if (wl_flush_watch_id != 0) {
+		g_source_remove(wl_flush_watch_id);
+		wl_flush_watch_id = 0;
+	}
+
+	if (wl_sync != NULL) {
+		wl_callback_destroy(wl_sync);
+		wl_sync = NULL;
+	}
+
+	g_slist_free_full(outputs, wl_ctrl_output_free);
+	outputs = NULL;
+
+	if (power_manager != NULL) {
+		zwlr_output_power_manager_v1_destroy(power_manager);
+		power_manager = NULL;
+	}
+
+	if (wl_reg != NULL) {
+		wl_registry_destroy(wl_reg);
+		wl_reg = NULL;
+	}
+
+	if (wl_dpy != NULL) {
+		wl_display_disconnect(wl_dpy);
+		wl_dpy = NULL;
+	}
+}
+
+/**
+ * Connect to the compositor, unless already connected;
+ * the globals are collected from the main loop, and outputs
+ * follow the current power mode as they are bound
+ *
+ * @return true if connected, false otherwise
+ */
+static bool wl_ctrl_connect(void)
+{
+	GIOChannel *channel;
+
+	if (wl_dpy != NULL)
+		return true;
+
+	wl_dpy = wl_display_connect(wl_socket);
+	if (wl_dpy == NULL) {
+		mce_log(LL_DEBUG, "%s: unable to connect to compositor",
+			MODULE_NAME);
+		return false;
+	}
+
+	wl_reg = wl_display_get_registry(wl_dpy);
+	wl_registry_add_listener(wl_reg, &registry_listener, NULL);
+
+	wl_sync = wl_display_sync(wl_dpy);
+	wl_callback_add_listener(wl_sync, &registry_sync_listener, NULL);
+
+	if (wl_ctrl_flush() == false) {
+		mce_log(LL_WARN, "%s: unable to send requests to compositor",
+			MODULE_NAME);
+		wl_ctrl_disconnect();
+		return false;
+	}
+
+	channel = g_io_channel_unix_new(wl_display_get_fd(wl_dpy));
+	wl_watch_id = g_io_add_watch(channel,
+				     G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				     wl_ctrl_io_cb, NULL);
+	g_io_channel_unref(channel);
+
+	mce_log(LL_INFO, "%s: connected to compositor", MODULE_NAME);
+
+	return true;
+}
+
+/**
+ * Timeout callback for retrying the connection to the compositor
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean wl_ctrl_retry_cb(gpointer data)
+{
+	(void)data;
+
+	wl_retry_id = 0;
+
+	if (wl_ctrl_connect() == false)
+		wl_ctrl_schedule_retry();
+
+	return FALSE;
+}
+
+/**
+ * Retry the connection to the compositor later, backing off
+ * while it stays unavailable
+ */
+static void wl_ctrl_schedule_retry(void)
+{
+	if (wl_retry_id != 0)
+		return;
+
+	wl_retry_id = g_timeout_add_seconds(wl_retry_delay,
+					    wl_ctrl_retry_cb, NULL);
+	wl_retry_delay = MIN(wl_retry_delay * 2, WL_CTRL_RETRY_MAX);
+}
+
+static void wl_ctrl_set_outputs_on(const bool on)
+{
+	outputs_on = on;
+
+	/* Outputs bound once connected follow outputs_on */
+	if (wl_dpy == NULL)
+		return;
+
+	mce_log(LL_DEBUG, "%s: turning outputs %s", MODULE_NAME,
+		on ? "on" : "off");
+
+	for (GSList *iter = outputs; iter; iter = iter->next)
+		wl_ctrl_output_set_mode(iter->data);
+
+	if (wl_ctrl_flush() == false) {
+		mce_log(LL_WARN, "%s: unable to flush requests to compositor",
+			MODULE_NAME);
+		wl_ctrl_disconnect();
+		wl_ctrl_schedule_retry();
+	}
+}
+
+static void display_state_trigger(gconstpointer data)
+{
+	static display_state_t old_state = MCE_DISPLAY_UNDEF;
+	display_state_t new_state = GPOINTER_TO_INT(data);
+
+	if (new_state != old_state) {
+		wl_ctrl_set_outputs_on(new_state != MCE_DISPLAY_OFF);
+		old_state = new_state;
+	}
+}
+
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
+const gchar *g_module_check_init(GModule *module)
+{
+	(void)module;
+
+	wl_socket = mce_conf_get_string(MCE_CONF_WAYLAND_CTRL_GROUP,
+					MCE_CONF_WAYLAND_CTRL_SOCKET,
+					NULL, NULL);
+
+	/* The compositor may not be up yet; in that case
+	 * the connection is retried with a growing delay
+	 */
+	if (wl_ctrl_connect() == false)
+		wl_ctrl_schedule_retry();
+
+	/* Append triggers/filters to datapipes */
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  display_state_trigger);
+
+	return NULL;
+}
+
+G_MODULE_EXPORT void g_module_unload(GModule *module);
+void g_module_unload(GModule *module)
+{
+	(void)module;
+
+	/* Remove triggers/filters from datapipes */
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    display_state_trigger);
+
+	if (wl_dpy != NULL)
+		wl_ctrl_set_outputs_on(true);
+
+	wl_ctrl_disconnect();
+
+	if (wl_retry_id != 0) {
+		g_source_remove(wl_retry_id);
+		wl_retry_id = 0;
+	}
+	g_free(wl_socket);
+}
@@ -12,125 +12,178 @@
 #include <linux/input.h>
 #include "mce-log.h"
 
-int mce_match_event_file_by_caps(const gchar *const filename,
-				    const int *const ev_types,
-				    const int *const ev_keys[])
+/**
+ * Open an input device and read its name, location, id and
+ * capabilities, so that matching it against any number of
+ * drivers and capabilities needs no further ioctls
+ *
+ * @param filename The event file of the device
+ * @return The device, NULL on failure; free with mce_input_device_free()
+ */
+mce_input_device_t *mce_input_device_open(const gchar *const filename)
 {
-	int ev_type, p, q;
+	mce_input_device_t *device = g_new0(mce_input_device_t, 1);
 	int version;
-	unsigned long bit[EV_MAX][NBITS(KEY_MAX)];
-	int fd;
 
-	if ((fd = open(filename, O_NONBLOCK | O_RDONLY)) == -1) {
+	if ((device->fd = open(filename, O_NONBLOCK | O_RDONLY)) == -1) {
 		mce_log(LL_DEBUG, "Failed to open `%s', skipping", filename);
 
 		/* Ignore error */
 		errno = 0;
-		return -1;
+		g_free(device);
+		return NULL;
 	}
 
+	if (ioctl(device->fd, EVIOCGNAME(sizeof (device->name) - 1),
+		  device->name) < 0)
+		mce_log(LL_WARN, "ioctl(EVIOCGNAME) failed on `%s'", filename);
+
+	/* Not every device has a location or an id */
+	(void)ioctl(device->fd, EVIOCGPHYS(sizeof (device->phys) - 1),
+		    device->phys);
+	(void)ioctl(device->fd, EVIOCGID, &device->id);
+
 	/* We use this ioctl to check if this device supports the input
 	 * ioctl's
-	*/
-	if (ioctl(fd, EVIOCGVERSION, &version) < 0) {
-		mce_log(LL_WARN,
-			"match_event_file_by_caps: can't get version on `%s'",
-			filename);
+	 */
+	if (ioctl(device->fd, EVIOCGVERSION, &version) < 0) {
+		mce_log(LL_WARN, "can't get version on `%s'", filename);
 		goto EXIT;
 	}
 
-	memset(bit, 0, sizeof(bit));
-	if (ioctl(fd, EVIOCGBIT(0, EV_MAX), bit[0]) < 0) {
-		mce_log(LL_WARN,
-			"match_event_file_by_caps: ioctl(EVIOCGBIT, EV_MAX) failed on `%s'",
+	if (ioctl(device->fd, EVIOCGBIT(0, sizeof (device->bits[0])),
+		  device->bits[0]) < 0) {
+		mce_log(LL_WARN, "ioctl(EVIOCGBIT, EV_MAX) failed on `%s'",
 			filename);
 		goto EXIT;
 	}
 
-	for (p = 0; ev_types[p] != -1; p ++) {
-		/* TODO: Could check that ev_types[p] is less than EV_MAX */
-		ev_type = ev_types[p];
-
-		/* event type not supported, try the next one */
-		if (!test_bit(ev_type, bit[0]))
+	/* Get the bits of every supported event type */
+	for (int ev_type = 1; ev_type < EV_CNT; ev_type++) {
+		if (!test_bit(ev_type, device->bits[0]))
 			continue;
 
-		/* Get bits per event type */
-		if (ioctl(fd, EVIOCGBIT(ev_type, KEY_MAX), bit[ev_type]) < 0) {
-			mce_log(LL_WARN,
-				"match_event_file_by_caps: ioctl(EVIOCGBIT, KEY_MAX) failed on `%s'",
-				filename);
-			goto EXIT;
-		}
-
-		for (q = 0; ev_keys[p][q] != -1; q ++) {
-			/* TODO: Could check that q is less than KEY_MAX */
-
-			/* succeed if at least one match is found */
-			if (test_bit(ev_keys[p][q], bit[ev_type])) {
-				mce_log(LL_DEBUG,
-					"match_event_file_by_caps: match found on `%s'", filename);
-				return fd;
-			}
+		if (ioctl(device->fd,
+			  EVIOCGBIT(ev_type, sizeof (device->bits[ev_type])),
+			  device->bits[ev_type]) < 0) {
+			mce_log(LL_WARN, "ioctl(EVIOCGBIT, %d) failed on `%s'",
+				ev_type, filename);
+			memset(device->bits[ev_type], 0,
+			       sizeof (device->bits[ev_type]));
 		}
 	}
 
+	errno = 0;
+
 EXIT:
-	close(fd);
+	mce_log(LL_DEBUG, "`%s' is `%s' at `%s'", filename,
+		device->name, device->phys);
 
-	return -1;
+	return device;
 }
 
 /**
- * Try to match /dev/input event file to a specific driver
+ * Take over the fd of an input device; it is no longer
+ * closed by mce_input_device_free()
  *
- * @param filename A string containing the name of the event file
- * @param drivers An array of driver names
- * @return An open file descriptor on success, -1 on failure
+ * @param device The device
+ * @return The open fd
  */
-int mce_match_event_file(const gchar *const filename,
-			    const gchar *const *const drivers)
+int mce_input_device_take_fd(mce_input_device_t *const device)
 {
-	static char name[256];
-	int fd = -1;
-	int i;
+	int fd = device->fd;
 
-	/* If we cannot open the file, abort */
-	if ((fd = open(filename, O_NONBLOCK | O_RDONLY)) == -1) {
-		mce_log(LL_DEBUG, "Failed to open `%s', skipping",
-			filename);
+	device->fd = -1;
 
-		/* Ignore error */
-		errno = 0;
-		goto EXIT;
-	}
+	return fd;
+}
 
-	for (i = 0; drivers[i] != NULL; i++) {
-		if (ioctl(fd, EVIOCGNAME(sizeof name), name) >= 0) {
-			if (strcmp(name, drivers[i]) == 0) {
-				/* We found our event file */
-				mce_log(LL_DEBUG,
-					"`%s' is `%s'",
-					filename, drivers[i]);
-				break;
-			}
-		} else {
-			mce_log(LL_WARN,
-				"ioctl(EVIOCGNAME) failed on `%s'",
-				filename);
+/**
+ * Free an input device, closing its fd unless it was taken
+ *
+ * @param device The device; may be NULL
+ */
+void mce_input_device_free(mce_input_device_t *const device)
+{
+	if (device == NULL)
+		return;
+
+	if (device->fd != -1)
+		close(device->fd);
+
+	g_free(device);
+}
+
+/**
+ * Match the capabilities of an input device
+ *
+ * @param device The device
+ * @param ev_types The event types, terminated by -1
+ * @param ev_keys The codes of each event type, each terminated by -1
+ * @return TRUE if the device has any of the codes, FALSE otherwise
+ */
+gboolean mce_input_device_match_caps(const mce_input_device_t *const device,
+				     const int *const ev_types,
+				     const int *const ev_keys[])
+{
+	for (int p = 0; ev_types[p] != -1; p++) {
+		int ev_type = ev_types[p];
+
+		/* event type not supported, try the next one */
+		if (ev_type >= EV_CNT || !test_bit(ev_type, device->bits[0]))
+			continue;
+
+		for (int q = 0; ev_keys[p][q] != -1; q++) {
+			/* succeed if at least one match is found */
+			if (ev_keys[p][q] < KEY_CNT &&
+			    test_bit(ev_keys[p][q], device->bits[ev_type]))
+				return TRUE;
 		}
 	}
 
-	/* If the scan terminated with drivers[i] == NULL,
-	 * we didn't find any match
-	 */
-	if (drivers[i] == NULL) {
-		close(fd);
-		fd = -1;
-	}
+	return FALSE;
+}
 
-EXIT:
-	return fd;
+/**
+ * Create a table mapping driver names to values,
+ * so that a device is matched against all drivers with one lookup
+ *
+ * @return The table; free with g_hash_table_destroy()
+ */
+GHashTable *mce_input_driver_table_new(void)
+{
+	return g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+/**
+ * Add driver names to a driver table; names that are
+ * already in the table get the new value
+ *
+ * @param table The driver table
+ * @param drivers The driver names, terminated by NULL;
+ *                must outlive the table
+ * @param value The value for the drivers, not 0
+ */
+void mce_input_driver_table_add(GHashTable *const table,
+				const gchar *const *const drivers,
+				const gint value)
+{
+	for (int i = 0; drivers[i] != NULL; i++)
+		g_hash_table_insert(table, (gpointer)drivers[i],
+				    GINT_TO_POINTER(value));
+}
+
+/**
+ * Look up the driver of an input device in a driver table
+ *
+ * @param device The device
+ * @param table The driver table
+ * @return The value of the driver, 0 if it is not in the table
+ */
+gint mce_input_device_lookup_driver(const mce_input_device_t *const device,
+				    GHashTable *const table)
+{
+	return GPOINTER_TO_INT(g_hash_table_lookup(table, device->name));
 }
 
 /**
@@ -2,6 +2,7 @@
 #define _EVENT_INPUT_UTILS_H_
 
 #include <glib.h>
+#include <linux/input.h>
 
 /** Path to the input device directory */
 #define DEV_INPUT_PATH			"/dev/input"
@@ -17,9 +18,24 @@
 
 typedef void (*mce_input_match_callback) (const char* filename);
 
-int mce_match_event_file_by_caps(const gchar *const filename, const int *const ev_types, const int *const ev_keys[]);
+/** Properties of an input device, read once when the device is opened */
+typedef struct {
+	int fd;					/**< Open fd, -1 once taken */
+	char name[256];				/**< Driver name */
+	char phys[256];				/**< Physical location */
+	struct input_id id;			/**< Bus, vendor, product, version */
+	unsigned long bits[EV_CNT][NBITS(KEY_CNT)];	/**< Capabilities */
+} mce_input_device_t;
 
-int mce_match_event_file(const gchar *const filename, const gchar *const *const drivers);
+mce_input_device_t *mce_input_device_open(const gchar *const filename);
+int mce_input_device_take_fd(mce_input_device_t *const device);
+void mce_input_device_free(mce_input_device_t *const device);
+
+gboolean mce_input_device_match_caps(const mce_input_device_t *const device, const int *const ev_types, const int *const ev_keys[]);
+
+GHashTable *mce_input_driver_table_new(void);
+void mce_input_driver_table_add(GHashTable *const table, const gchar *const *const drivers, const gint value);
+gint mce_input_device_lookup_driver(const mce_input_device_t *const device, GHashTable *const table);
 
 gboolean mce_scan_inputdevices(mce_input_match_callback match_callback);
 
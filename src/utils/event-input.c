@@ -59,6 +59,39 @@ static GSList *misc_dev_list = NULL;
 /** List of switch input devices */
 static GSList *switch_dev_list = NULL;
 
+/** Classes of input devices, from the driver name or the capabilities */
+typedef enum {
+	/** Not matched by driver name */
+	INPUT_CLASS_UNKNOWN = 0,
+	/** Driver is blacklisted */
+	INPUT_CLASS_BLACKLISTED = 1,
+	/** Touchscreen */
+	INPUT_CLASS_TOUCHSCREEN = 2,
+	/** Keyboard */
+	INPUT_CLASS_KEYBOARD = 3,
+	/** Switches */
+	INPUT_CLASS_SWITCH = 4,
+	/** Anything else */
+	INPUT_CLASS_MISC = 5
+} input_class_t;
+
+/** Known driver names, mapped to their input_class_t */
+static GHashTable *driver_table = NULL;
+
+/** ID for lid switch debounce timeout source */
+static guint lid_debounce_timeout_cb_id = 0;
+/** Last lid state seen from the switch */
+static cover_state_t lid_switch_state = COVER_UNDEF;
+/** Last lid state reported to lid_cover_pipe */
+static cover_state_t lid_reported_state = COVER_UNDEF;
+/** Time of the last lid switch change, in monotonic microseconds */
+static gint64 lid_switch_time = 0;
+
+/** Is the touchscreen grabbed by the event eater? */
+static gboolean touchscreen_grabbed = FALSE;
+/** Time the event eater released the touchscreen, 0 if not pending */
+static gint64 touchscreen_release_time = 0;
+
 /** GFile pointer for the directory we monitor */
 GFile *dev_input_gfp = NULL;
 /** GFileMonitor pointer for the directory we monitor */
@@ -105,6 +138,55 @@ static void unregister_io_monitor(gpointer io_monitor, gpointer user_data)
 	mce_unregister_io_monitor(io_monitor);
 }
 
+/**
+ * Grab or release a touchscreen device from g_slist_foreach()
+ *
+ * While grabbed, events from the device are delivered only to MCE
+ *
+ * @param io_monitor The I/O monitor of the touchscreen device
+ * @param grab GINT_TO_POINTER(TRUE) to grab, GINT_TO_POINTER(FALSE) to release
+ */
+static void grab_touchscreen(gpointer io_monitor, gpointer grab)
+{
+	int fd = mce_get_io_monitor_fd(io_monitor);
+
+	if (fd == -1)
+		return;
+
+	if (ioctl(fd, EVIOCGRAB, GPOINTER_TO_INT(grab) ? 1 : 0) == -1) {
+		mce_log(LL_WARN, "Failed to %s touchscreen %s; %s",
+			GPOINTER_TO_INT(grab) ? "grab" : "release",
+			mce_get_io_monitor_name(io_monitor),
+			g_strerror(errno));
+	}
+}
+
+/**
+ * Grab or release all touchscreen devices for the event eater
+ *
+ * @param grab TRUE to grab the touchscreens, FALSE to release them
+ */
+static void set_touchscreen_grab(gboolean grab)
+{
+	if (touchscreen_grabbed == grab)
+		return;
+
+	touchscreen_grabbed = grab;
+
+	if (touchscreen_dev_list != NULL) {
+		g_slist_foreach(touchscreen_dev_list,
+				(GFunc)grab_touchscreen, GINT_TO_POINTER(grab));
+	}
+
+	if (grab == TRUE) {
+		touchscreen_release_time = 0;
+		mce_log(LL_DEBUG, "Touchscreen grabbed by event eater");
+	} else {
+		touchscreen_release_time = g_get_monotonic_time();
+		mce_log(LL_DEBUG, "Touchscreen released by event eater");
+	}
+}
+
 /**
  * Timeout function for touchscreen I/O monitor reprogramming
  *
@@ -168,6 +250,23 @@ static void touchscreen_cb(gpointer data, gsize bytes_read)
 		goto EXIT;
 	}
 
+	if ((ev->type == EV_KEY) && (ev->code == BTN_TOUCH)) {
+		/* The grab eats one complete touch;
+		 * release it when the finger is lifted
+		 */
+		if ((touchscreen_grabbed == TRUE) && (ev->value == 0)) {
+			set_touchscreen_grab(FALSE);
+		} else if ((touchscreen_release_time != 0) &&
+			   (ev->value == 1)) {
+			mce_log(LL_DEBUG,
+				"First touch delivered %" G_GINT64_FORMAT
+				" ms after event eater release",
+				(g_get_monotonic_time() -
+				 touchscreen_release_time) / 1000);
+			touchscreen_release_time = 0;
+		}
+	}
+
 	/* Ignore unwanted events */
 	if (ev->type != EV_ABS) {
 		goto EXIT;
@@ -181,10 +280,12 @@ static void touchscreen_cb(gpointer data, gsize bytes_read)
 			       USE_INDATA, CACHE_INDATA);
 
 	/* If visual tklock is active or autorelock isn't active,
-	 * suspend I/O monitors
+	 * suspend I/O monitors; while the event eater holds the grab
+	 * keep reading, so that the release is seen promptly
 	 */
-	if (((submode & MCE_VISUAL_TKLOCK_SUBMODE) != 0) ||
-	    ((submode & MCE_AUTORELOCK_SUBMODE) == 0)) {
+	if ((touchscreen_grabbed == FALSE) &&
+	    (((submode & MCE_VISUAL_TKLOCK_SUBMODE) != 0) ||
+	     ((submode & MCE_AUTORELOCK_SUBMODE) == 0))) {
 		if (touchscreen_dev_list != NULL) {
 			g_slist_foreach(touchscreen_dev_list,
 					(GFunc)suspend_io_monitor, NULL);
@@ -252,6 +353,23 @@ static void setup_keypress_repeat_timeout(void)
 				      keypress_repeat_timeout_cb, NULL);
 }
 
+/**
+ * Handle a camera key event
+ *
+ * @param ev The key event
+ */
+static void camera_key_event(const struct input_event *ev)
+{
+	/* Key repeats carry no new information */
+	if (ev->value == 2)
+		return;
+
+	execute_datapipe(&camera_button_pipe,
+			 GINT_TO_POINTER(ev->value ? CAMERA_BUTTON_LAUNCH :
+					 CAMERA_BUTTON_UNPRESSED),
+			 USE_INDATA, CACHE_INDATA);
+}
+
 /**
  * I/O monitor callback for keypresses
  *
@@ -297,6 +415,9 @@ static void keypress_cb(gpointer data, gsize bytes_read)
 		}
 	}
 
+	if (ev->code == KEY_CAMERA)
+		camera_key_event(ev);
+
 	if ((ev->value == 1) || (ev->value == 0)) {
 		(void)execute_datapipe(&keypress_pipe, &ev,
 				       USE_INDATA, DONT_CACHE_INDATA);
@@ -306,6 +427,122 @@ EXIT:
 	return;
 }
 
+/**
+ * Report the lid state, unless already reported
+ *
+ * @param state The lid state
+ */
+static void report_lid_state(cover_state_t state)
+{
+	if (state == lid_reported_state)
+		return;
+
+	lid_reported_state = state;
+
+	mce_log(LL_DEBUG, "Lid %s",
+		state == COVER_CLOSED ? "closed" : "opened");
+	execute_datapipe(&lid_cover_pipe, GINT_TO_POINTER(state),
+			 USE_INDATA, CACHE_INDATA);
+}
+
+/**
+ * Timeout callback for lid switch debouncing
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean lid_debounce_timeout_cb(gpointer data)
+{
+	(void)data;
+
+	lid_debounce_timeout_cb_id = 0;
+
+	report_lid_state(lid_switch_state);
+
+	return FALSE;
+}
+
+/**
+ * Cancel timeout for lid switch debouncing
+ */
+static void cancel_lid_debounce_timeout(void)
+{
+	if (lid_debounce_timeout_cb_id != 0) {
+		g_source_remove(lid_debounce_timeout_cb_id);
+		lid_debounce_timeout_cb_id = 0;
+	}
+}
+
+/**
+ * Handle a lid switch event
+ *
+ * A change after the switch has been stable for the debounce delay
+ * is reported at once, so that closing the lid blanks the display
+ * without delay; changes while the switch is bouncing are reported
+ * once it has been stable for the debounce delay
+ *
+ * @param ev The switch event
+ */
+static void lid_switch_event(const struct input_event *ev)
+{
+	gint64 now = g_get_monotonic_time();
+	gboolean bouncing = ((lid_debounce_timeout_cb_id != 0) ||
+			     ((now - lid_switch_time) <
+			      LID_DEBOUNCE_DELAY * 1000));
+
+	lid_switch_state = ev->value ? COVER_CLOSED : COVER_OPEN;
+	lid_switch_time = now;
+
+	mce_log(LL_DEBUG, "Lid switch event delivered after %" G_GINT64_FORMAT
+		" us", g_get_real_time() -
+		((gint64)ev->time.tv_sec * G_USEC_PER_SEC + ev->time.tv_usec));
+
+	cancel_lid_debounce_timeout();
+
+	if (bouncing == FALSE) {
+		report_lid_state(lid_switch_state);
+	} else {
+		lid_debounce_timeout_cb_id =
+			g_timeout_add(LID_DEBOUNCE_DELAY,
+				      lid_debounce_timeout_cb, NULL);
+	}
+}
+
+/**
+ * Publish the initial state of the switches of a switch device
+ *
+ * @param fd File descriptor of the switch device
+ */
+static void query_switch_state(const int fd)
+{
+	unsigned long caps[NBITS(SW_MAX)];
+	unsigned long state[NBITS(SW_MAX)];
+
+	memset(caps, 0, sizeof (caps));
+	memset(state, 0, sizeof (state));
+
+	if ((ioctl(fd, EVIOCGBIT(EV_SW, SW_MAX), caps) < 0) ||
+	    (ioctl(fd, EVIOCGSW(SW_MAX), state) < 0)) {
+		errno = 0;
+		return;
+	}
+
+	if (test_bit(SW_CAMERA_LENS_COVER, caps))
+		execute_datapipe(&lens_cover_pipe,
+				 GINT_TO_POINTER(test_bit(SW_CAMERA_LENS_COVER,
+							  state) ?
+						 COVER_CLOSED : COVER_OPEN),
+				 USE_INDATA, CACHE_INDATA);
+
+	/* The lid has not moved; no debouncing needed */
+	if (test_bit(SW_LID, caps)) {
+		cancel_lid_debounce_timeout();
+		lid_switch_state = test_bit(SW_LID, state) ?
+				   COVER_CLOSED : COVER_OPEN;
+		report_lid_state(lid_switch_state);
+	}
+}
+
 /**
  * I/O monitor callback for switch
  *
@@ -316,6 +553,7 @@ static void switch_cb(gpointer data, gsize bytes_read)
 {
 	struct input_event *ev;
 	gboolean handled = FALSE;
+	gboolean activity = TRUE;
 
 	ev = data;
 
@@ -333,8 +571,17 @@ static void switch_cb(gpointer data, gsize bytes_read)
 				break;
 			}
 			case SW_CAMERA_LENS_COVER: {
-				execute_datapipe(&camera_button_pipe, GINT_TO_POINTER(ev->value),
-								 USE_INDATA, CACHE_INDATA);
+				execute_datapipe(&lens_cover_pipe,
+						 GINT_TO_POINTER(ev->value ? COVER_CLOSED :
+								 COVER_OPEN),
+						 USE_INDATA, CACHE_INDATA);
+				handled = TRUE;
+				break;
+			}
+			case SW_LID: {
+				lid_switch_event(ev);
+				/* Closing the lid is not user activity */
+				activity = (ev->value == 0);
 				handled = TRUE;
 				break;
 			}
@@ -350,12 +597,16 @@ static void switch_cb(gpointer data, gsize bytes_read)
 				break;
 			}
 			case KEY_CAMERA: {
-				execute_datapipe(&camera_button_pipe, GINT_TO_POINTER(ev->value),
-								 USE_INDATA, CACHE_INDATA);
+				camera_key_event(ev);
 				handled = TRUE;
 				break;
 			}
 			case KEY_CAMERA_FOCUS: {
+				/* The focus half-press belongs to the camera
+				 * application, which reads the device itself;
+				 * keep it away from the keypress handlers so
+				 * it does not count as a key press
+				 */
 				handled = TRUE;
 				break;
 			}
@@ -367,8 +618,9 @@ static void switch_cb(gpointer data, gsize bytes_read)
 	if (!handled && (ev->value == 1 || ev->value == 0))
 		(void)execute_datapipe(&keypress_pipe, &ev, USE_INDATA, DONT_CACHE_INDATA);
 
-	execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-				USE_INDATA, CACHE_INDATA);
+	if (activity == TRUE)
+		execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
+					USE_INDATA, CACHE_INDATA);
 }
 
 /**
@@ -495,69 +747,121 @@ static void register_io_monitor_chunk(const gint fd, const gchar *const file,
 			close(fd);
 	} else {
 		*devices = g_slist_prepend(*devices, (gpointer)iomon);
+
+		/* Touchscreens added while eating events are grabbed too */
+		if ((devices == &touchscreen_dev_list) &&
+		    (touchscreen_grabbed == TRUE))
+			grab_touchscreen((gpointer)iomon, GINT_TO_POINTER(TRUE));
+
+		/* Switches only report changes; publish where they are now */
+		if (devices == &switch_dev_list)
+			query_switch_state(mce_get_io_monitor_fd(iomon));
+	}
+}
+
+/**
+ * Classify an input device; the driver name takes precedence over
+ * the capabilities in the same order as the classes are listed
+ *
+ * @param device The device
+ * @return The class of the device
+ */
+static input_class_t classify_input_device(const mce_input_device_t *device)
+{
+	input_class_t class = mce_input_device_lookup_driver(device,
+							     driver_table);
+
+	if ((class == INPUT_CLASS_BLACKLISTED) ||
+	    (class == INPUT_CLASS_TOUCHSCREEN))
+		goto EXIT;
+
+	if (mce_input_device_match_caps(device, touch_event_types,
+					touch_event_keys) == TRUE) {
+		class = INPUT_CLASS_TOUCHSCREEN;
+	} else if ((class == INPUT_CLASS_KEYBOARD) ||
+		   (mce_input_device_match_caps(device, power_event_types,
+						power_event_keys) == TRUE) ||
+		   (mce_input_device_match_caps(device, keyboard_event_types,
+						keyboard_event_keys) == TRUE)) {
+		class = INPUT_CLASS_KEYBOARD;
+	} else if (mce_input_device_match_caps(device, switch_event_types,
+					       switch_event_keys) == TRUE) {
+		class = INPUT_CLASS_SWITCH;
+	} else {
+		class = INPUT_CLASS_MISC;
 	}
+
+EXIT:
+	return class;
 }
 
 /**
  * Match and register I/O monitor
+ *
+ * The device is opened once; its descriptor is used both for
+ * the classification and for the I/O monitor
+ *
+ * @param filename The event file of the device
+ * @param ts_only TRUE to register touchscreens only
  */
-static void match_and_register_io_monitor(const gchar *filename)
+static void match_and_register_device(const gchar *filename, gboolean ts_only)
 {
+	mce_input_device_t *device = NULL;
+	input_class_t class;
 	int fd;
-	gboolean match = FALSE;
 
-	if ((fd = mce_match_event_file(filename, driver_blacklist)) != -1) {
-		/* If the driver for the event file is blacklisted, skip it */
-		close(fd);
+	/* Only open event* devices */
+	if (strstr(filename, "event") == NULL)
 		goto EXIT;
-	} else if (strstr(filename, "event") == NULL) {
-		/* Only open event* devices */
+
+	if ((device = mce_input_device_open(filename)) == NULL)
 		goto EXIT;
-	} else if ((fd = mce_match_event_file(filename,
-					  touchscreen_event_drivers)) != -1) {
-		mce_log(LL_DEBUG, "Registering %s as touchscreen fd: %i", filename, fd);
-		register_io_monitor_chunk(fd, filename, touchscreen_cb,
-					  &touchscreen_dev_list);
-		match = TRUE;
-	} else if ((fd = mce_match_event_file_by_caps(filename,
-					  touch_event_types, touch_event_keys)) != -1) {
+
+	class = classify_input_device(device);
+
+	/* If the driver for the event file is blacklisted, skip it */
+	if ((class == INPUT_CLASS_BLACKLISTED) ||
+	    ((ts_only == TRUE) && (class != INPUT_CLASS_TOUCHSCREEN)))
+		goto EXIT;
+
+	fd = mce_input_device_take_fd(device);
+
+	switch (class) {
+	case INPUT_CLASS_TOUCHSCREEN:
 		mce_log(LL_DEBUG, "Registering %s as touchscreen fd: %i", filename, fd);
 		register_io_monitor_chunk(fd, filename, touchscreen_cb,
 					  &touchscreen_dev_list);
-		match = TRUE;
-	} else if ((fd = mce_match_event_file(filename,
-					  keyboard_event_drivers)) != -1) {
-		mce_log(LL_DEBUG, "Registering %s as keyboard fd: %i", filename, fd);
-		register_io_monitor_chunk(fd, filename, keypress_cb,
-					  &keyboard_dev_list);
-		match = TRUE;
-	} else if ((fd = mce_match_event_file_by_caps(filename, power_event_types,
-					   power_event_keys)) != -1) {
-		mce_log(LL_DEBUG, "Registering %s as keyboard fd: %i", filename, fd);
-		register_io_monitor_chunk(fd, filename, keypress_cb,
-					  &keyboard_dev_list);
-		match = TRUE;
-	}  else if ((fd = mce_match_event_file_by_caps(filename, keyboard_event_types,
-					   keyboard_event_keys)) != -1) {
+		break;
+
+	case INPUT_CLASS_KEYBOARD:
 		mce_log(LL_DEBUG, "Registering %s as keyboard fd: %i", filename, fd);
 		register_io_monitor_chunk(fd, filename, keypress_cb,
 					  &keyboard_dev_list);
-		match = TRUE;
-	} else if ((fd = mce_match_event_file_by_caps(filename, switch_event_types,
-					   switch_event_keys)) != -1) {
+		break;
+
+	case INPUT_CLASS_SWITCH:
 		mce_log(LL_DEBUG, "Registering %s as switchboard fd: %i", filename, fd);
 		register_io_monitor_chunk(fd, filename, switch_cb,
 					  &switch_dev_list);
-		match = TRUE;
-	}
+		break;
 
-	if (!match) {
+	default:
+		mce_log(LL_DEBUG, "Registering %s as misc input device fd: %i", filename, fd);
 		register_io_monitor_chunk(fd, filename, misc_cb,
 					  &misc_dev_list);
-		mce_log(LL_DEBUG, "Registering %s as misc input device fd: %i", filename, fd);
+		break;
 	}
 
-EXIT:;
+EXIT:
+	mce_input_device_free(device);
+}
+
+/**
+ * Match and register I/O monitor
+ */
+static void match_and_register_io_monitor(const gchar *filename)
+{
+	match_and_register_device(filename, FALSE);
 }
 
 static void remove_input_device(GSList **devices, const gchar *device)
@@ -693,29 +997,7 @@ static void dir_changed_cb(GFileMonitor *monitor,
 }
 
 static void match_ts_only(const gchar* filename) {
-	int fd;
-
-	if ((fd = mce_match_event_file(filename, driver_blacklist)) != -1) {
-		/* If the driver for the event file is blacklisted, skip it */
-		close(fd);
-		return;
-	}
-
-	if ((fd = mce_match_event_file(filename,
-					  touchscreen_event_drivers)) != -1) {
-		register_io_monitor_chunk(fd, filename, touchscreen_cb,
-					  &touchscreen_dev_list);
-		mce_log(LL_DEBUG, "Registering %s as touchscreen fd: %i", filename, fd);
-		return;
-	} else if ((fd = mce_match_event_file_by_caps(filename,
-					  touch_event_types, touch_event_keys)) != -1) {
-		register_io_monitor_chunk(fd, filename, touchscreen_cb,
-					  &touchscreen_dev_list);
-		mce_log(LL_DEBUG, "Registering %s as touchscreen fd: %i", filename, fd);
-		return;
-	}
-
-	close(fd);
+	match_and_register_device(filename, TRUE);
 }
 
 static void mce_reopen_touchscreen_devices(void) {
@@ -732,6 +1014,29 @@ static void touchscreen_control_trigger(gconstpointer data) {
 		unregister_touchscreen_devices();
 }
 
+/**
+ * Handle submode change
+ *
+ * Grab the touchscreens when the event eater is enabled,
+ * and release them when it is disabled
+ *
+ * @param data The submode stored in a pointer
+ */
+static void submode_trigger(gconstpointer data)
+{
+	static submode_t old_submode = MCE_NORMAL_SUBMODE;
+	submode_t submode = GPOINTER_TO_INT(data);
+
+	if ((submode & MCE_EVEATER_SUBMODE) != 0 &&
+	    (old_submode & MCE_EVEATER_SUBMODE) == 0)
+		set_touchscreen_grab(TRUE);
+	else if ((submode & MCE_EVEATER_SUBMODE) == 0 &&
+		 (old_submode & MCE_EVEATER_SUBMODE) != 0)
+		set_touchscreen_grab(FALSE);
+
+	old_submode = submode;
+}
+
 /**
  * Init function for the /dev/input event component
  *
@@ -748,6 +1053,17 @@ gboolean mce_input_init(void)
 
 	power_keycode = mce_conf_get_int(MCE_CONF_POWERKEY_GROUP, MCE_CONF_POWERKEY_KEYCODE, KEY_POWER, NULL);
 
+	/* Look up all driver names at once; on a name listed more than
+	 * once, the class added last wins
+	 */
+	driver_table = mce_input_driver_table_new();
+	mce_input_driver_table_add(driver_table, keyboard_event_drivers,
+				   INPUT_CLASS_KEYBOARD);
+	mce_input_driver_table_add(driver_table, touchscreen_event_drivers,
+				   INPUT_CLASS_TOUCHSCREEN);
+	mce_input_driver_table_add(driver_table, driver_blacklist,
+				   INPUT_CLASS_BLACKLISTED);
+
 	/* Retrieve a GFile pointer to the directory to monitor */
 	dev_input_gfp = g_file_new_for_path(DEV_INPUT_PATH);
 
@@ -779,6 +1095,8 @@ gboolean mce_input_init(void)
 
 	append_output_trigger_to_datapipe(&touchscreen_suspend_pipe,
 					touchscreen_control_trigger);
+	append_output_trigger_to_datapipe(&submode_pipe,
+					submode_trigger);
 
 EXIT:
 	g_clear_error(&error);
@@ -794,15 +1112,24 @@ void mce_input_exit(void)
 	if (dev_input_gfmp != NULL)
 		g_file_monitor_cancel(dev_input_gfmp);
 
+	remove_output_trigger_from_datapipe(&submode_pipe,
+					submode_trigger);
 	remove_output_trigger_from_datapipe(&touchscreen_suspend_pipe,
 					touchscreen_control_trigger);
 
+	set_touchscreen_grab(FALSE);
 	unregister_inputdevices();
 
 	/* Remove all timer sources */
+	cancel_lid_debounce_timeout();
 	cancel_touchscreen_io_monitor_timeout();
 	cancel_keypress_repeat_timeout();
 	cancel_misc_io_monitor_timeout();
 
+	if (driver_table != NULL) {
+		g_hash_table_destroy(driver_table);
+		driver_table = NULL;
+	}
+
 	return;
 }
@@ -102,6 +102,7 @@ static const int event_switches[] = {
 	SW_CAMERA_LENS_COVER,
 	SW_KEYPAD_SLIDE,
 	SW_FRONT_PROXIMITY,
+	SW_LID,
 	-1
 };
 
@@ -214,6 +215,9 @@ static const gchar *const driver_blacklist[] = {
 
 #define MONITORING_DELAY		1
 
+/** Time in milliseconds the lid switch has to be stable to be reported */
+#define LID_DEBOUNCE_DELAY		50
+
 
 /* When MCE is made modular, this will be handled differently */
 gboolean mce_input_init(void);
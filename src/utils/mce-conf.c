@@ -38,6 +38,16 @@ struct mce_conf_file
 static struct mce_conf_file *conf_files = NULL;
 static size_t mce_conf_file_count = 0;
 
+/** A settings struct bound to a configuration group */
+typedef struct {
+	const gchar *group;			/**< Configuration group */
+	const mce_conf_binding_t *bindings;	/**< Bound keys */
+	gpointer settings;			/**< Settings struct */
+} mce_conf_bound_t;
+
+/** List of mce_conf_bound_t */
+static GSList *bound_settings = NULL;
+
 static struct mce_conf_file *mce_conf_find_key_in_files(const gchar *group, const gchar *key) 
 {
 	GError *error = NULL;
@@ -286,6 +296,338 @@ EXIT:
 	return tmp;
 }
 
+/**
+ * Release the value of a bound field
+ *
+ * @param binding The binding of the field
+ * @param settings The settings struct
+ */
+static void mce_conf_clear_field(const mce_conf_binding_t *binding,
+				 gpointer settings)
+{
+	gpointer field = G_STRUCT_MEMBER_P(settings, binding->offset);
+	mce_conf_int_list_t *list;
+
+	switch (binding->type) {
+	case MCE_CONF_TYPE_STRING:
+		g_free(*(gchar **)field);
+		*(gchar **)field = NULL;
+		break;
+
+	case MCE_CONF_TYPE_INT_LIST:
+		list = field;
+		g_free(list->values);
+		list->values = NULL;
+		list->length = 0;
+		break;
+
+	case MCE_CONF_TYPE_INT_MAP:
+		if (*(GHashTable **)field != NULL)
+			g_hash_table_destroy(*(GHashTable **)field);
+
+		*(GHashTable **)field = NULL;
+		break;
+
+	case MCE_CONF_TYPE_BOOL:
+	case MCE_CONF_TYPE_INT:
+	default:
+		break;
+	}
+}
+
+/**
+ * Check an integer against the valid range of its binding
+ *
+ * @param group The configuration group
+ * @param binding The binding
+ * @param value The value
+ * @return TRUE if the value is valid, FALSE otherwise
+ */
+static gboolean mce_conf_check_range(const gchar *group,
+				     const mce_conf_binding_t *binding,
+				     const gint value)
+{
+	if ((value >= binding->min) && (value <= binding->max))
+		return TRUE;
+
+	mce_log(LL_WARN, "mce-conf: "
+		"Config key %s/%s value %d is outside %d..%d",
+		group, binding->key, value, binding->min, binding->max);
+
+	return FALSE;
+}
+
+/**
+ * Fill in a map of every key of a group to its integer value;
+ * files of higher priority override the others
+ *
+ * @param group The configuration group
+ * @param binding The binding of the field
+ * @return The map
+ */
+static GHashTable *mce_conf_fill_int_map(const gchar *group,
+					 const mce_conf_binding_t *binding)
+{
+	GHashTable *map = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
+
+	for (size_t i = 0; (conf_files != NULL) && (i < mce_conf_file_count); i++) {
+		gchar **keys;
+
+		if (conf_files[i].keyfile == NULL)
+			continue;
+
+		keys = g_key_file_get_keys(conf_files[i].keyfile,
+					   group, NULL, NULL);
+
+		for (gsize j = 0; (keys != NULL) && (keys[j] != NULL); j++) {
+			GError *error = NULL;
+			gint value;
+
+			value = g_key_file_get_integer(conf_files[i].keyfile,
+						       group, keys[j], &error);
+
+			if (error != NULL) {
+				mce_log(LL_WARN, "mce-conf: "
+					"Could not get config key %s/%s; %s",
+					group, keys[j], error->message);
+				g_clear_error(&error);
+				continue;
+			}
+
+			if (mce_conf_check_range(group, binding, value) == FALSE)
+				continue;
+
+			g_hash_table_replace(map, g_strdup(keys[j]),
+					     GINT_TO_POINTER(value));
+		}
+
+		g_strfreev(keys);
+	}
+
+	return map;
+}
+
+/**
+ * Fill in a bound field from the configuration files,
+ * or from its default
+ *
+ * @param group The configuration group
+ * @param binding The binding of the field
+ * @param settings The settings struct
+ */
+static void mce_conf_fill_field(const gchar *group,
+				const mce_conf_binding_t *binding,
+				gpointer settings)
+{
+	gpointer field = G_STRUCT_MEMBER_P(settings, binding->offset);
+	struct mce_conf_file *conf_file;
+	mce_conf_int_list_t *list;
+	GError *error = NULL;
+	gboolean valid = TRUE;
+	gint value;
+
+	mce_conf_clear_field(binding, settings);
+
+	/* Keys that are not set silently get their defaults */
+	conf_file = mce_conf_find_key_in_files(group, binding->key);
+
+	switch (binding->type) {
+	case MCE_CONF_TYPE_BOOL:
+		*(gboolean *)field = binding->defaultval;
+
+		if (conf_file == NULL)
+			break;
+
+		value = g_key_file_get_boolean(conf_file->keyfile, group,
+					       binding->key, &error);
+
+		if (error == NULL)
+			*(gboolean *)field = value;
+
+		break;
+
+	case MCE_CONF_TYPE_INT:
+		*(gint *)field = binding->defaultval;
+
+		if (conf_file == NULL)
+			break;
+
+		value = g_key_file_get_integer(conf_file->keyfile, group,
+					       binding->key, &error);
+
+		if ((error == NULL) &&
+		    (mce_conf_check_range(group, binding, value) == TRUE))
+			*(gint *)field = value;
+
+		break;
+
+	case MCE_CONF_TYPE_STRING:
+		if (conf_file != NULL)
+			*(gchar **)field =
+				g_key_file_get_string(conf_file->keyfile,
+						      group, binding->key,
+						      &error);
+
+		if (*(gchar **)field == NULL)
+			*(gchar **)field = g_strdup(binding->defaultstr);
+
+		break;
+
+	case MCE_CONF_TYPE_INT_MAP:
+		*(GHashTable **)field = mce_conf_fill_int_map(group, binding);
+		break;
+
+	case MCE_CONF_TYPE_INT_LIST:
+		list = field;
+
+		if (conf_file == NULL)
+			break;
+
+		list->values =
+			g_key_file_get_integer_list(conf_file->keyfile,
+						    group, binding->key,
+						    &list->length, &error);
+
+		for (gsize i = 0; (error == NULL) && (i < list->length); i++)
+			valid &= mce_conf_check_range(group, binding,
+						      list->values[i]);
+
+		if ((error != NULL) || (valid == FALSE))
+			mce_conf_clear_field(binding, settings);
+
+		break;
+
+	default:
+		break;
+	}
+
+	if (error != NULL) {
+		mce_log(LL_WARN, "mce-conf: "
+			"Could not get config key %s/%s; %s; "
+			"using the default",
+			group, binding->key, error->message);
+	}
+
+	g_clear_error(&error);
+}
+
+/**
+ * Report keys of a bound group that have no binding,
+ * such as misspelled or obsolete keys
+ *
+ * @param bound The bound settings
+ */
+static void mce_conf_check_keys(const mce_conf_bound_t *bound)
+{
+	if (conf_files == NULL)
+		return;
+
+	for (size_t i = 0; i < mce_conf_file_count; i++) {
+		gchar **keys;
+
+		if (conf_files[i].keyfile == NULL)
+			continue;
+
+		keys = g_key_file_get_keys(conf_files[i].keyfile,
+					   bound->group, NULL, NULL);
+
+		for (gsize j = 0; (keys != NULL) && (keys[j] != NULL); j++) {
+			const mce_conf_binding_t *binding;
+
+			for (binding = bound->bindings; binding->key != NULL;
+			     binding++) {
+				if ((binding->type == MCE_CONF_TYPE_INT_MAP) ||
+				    (strcmp(binding->key, keys[j]) == 0))
+					break;
+			}
+
+			if (binding->key == NULL)
+				mce_log(LL_WARN, "mce-conf: "
+					"Unknown config key %s/%s in %s",
+					bound->group, keys[j],
+					conf_files[i].filename);
+		}
+
+		g_strfreev(keys);
+	}
+}
+
+/**
+ * Fill in all fields of bound settings
+ *
+ * @param data The bound settings
+ * @param user_data Unused
+ */
+static void mce_conf_fill_bound(gpointer data, gpointer user_data)
+{
+	const mce_conf_bound_t *bound = data;
+
+	(void)user_data;
+
+	mce_conf_check_keys(bound);
+
+	for (const mce_conf_binding_t *binding = bound->bindings;
+	     binding->key != NULL; binding++)
+		mce_conf_fill_field(bound->group, binding, bound->settings);
+}
+
+/**
+ * Bind a configuration group to a settings struct; the fields are
+ * filled in now and whenever the configuration is reloaded, so that
+ * reading them needs no further lookups
+ *
+ * The bindings should cover every key of the group,
+ * since keys without a binding are reported as unknown;
+ * a settings struct may be bound to more than one group
+ *
+ * @param group The configuration group
+ * @param bindings The bound keys, terminated by MCE_CONF_BIND_END
+ * @param settings The settings struct, zeroed before the first bind;
+ *                 release it with mce_conf_unbind()
+ */
+void mce_conf_bind(const gchar *group,
+		   const mce_conf_binding_t *bindings, gpointer settings)
+{
+	mce_conf_bound_t *bound = g_new0(mce_conf_bound_t, 1);
+
+	bound->group = group;
+	bound->bindings = bindings;
+	bound->settings = settings;
+
+	bound_settings = g_slist_append(bound_settings, bound);
+
+	mce_conf_fill_bound(bound, NULL);
+}
+
+/**
+ * Unbind a settings struct from all its groups,
+ * and free its string, list and map fields
+ *
+ * @param settings The settings struct
+ */
+void mce_conf_unbind(gpointer settings)
+{
+	GSList *iter = bound_settings;
+
+	while (iter != NULL) {
+		mce_conf_bound_t *bound = iter->data;
+		GSList *next = iter->next;
+
+		if (bound->settings == settings) {
+			for (const mce_conf_binding_t *binding = bound->bindings;
+			     binding->key != NULL; binding++)
+				mce_conf_clear_field(binding, settings);
+
+			bound_settings = g_slist_delete_link(bound_settings,
+							     iter);
+			g_free(bound);
+		}
+
+		iter = next;
+	}
+}
+
 /**
  * Free configuration file
  *
@@ -359,16 +701,38 @@ static gboolean mce_conf_is_ini_file(const char *filename)
 }
 
 /**
- * Init function for the mce-conf component
+ * Free a table of configuration files
  *
- * @return TRUE on success, FALSE on failure
+ * @param files The table; may be NULL
+ * @param count The number of entries in the table
  */
-gboolean mce_conf_init(void)
+static void mce_conf_free_files(struct mce_conf_file *files, size_t count)
 {
+	for (size_t i = 0; (files != NULL) && (i < count); ++i) {
+		g_free(files[i].filename);
+		g_free(files[i].path);
+		mce_conf_free_conf_file(files[i].keyfile);
+	}
+
+	free(files);
+}
+
+/**
+ * Read the main configuration file and the override files
+ * into a new table
+ *
+ * @param[out] count The number of entries in the table; 0 on failure
+ * @return The table on success, NULL on failure
+ */
+static struct mce_conf_file *mce_conf_load_files(size_t *count)
+{
+	struct mce_conf_file *files = NULL;
+	size_t file_count = 1;
 	DIR *dir = NULL;
-	mce_conf_file_count = 1;
 	struct dirent *direntry;
 
+	*count = 0;
+
 	gchar *override_dir_path = g_strconcat(G_STRINGIFY(MCE_CONF_DIR), "/", 
 										 G_STRINGIFY(MCE_CONF_OVERRIDE_DIR), NULL);
 	dir = opendir(override_dir_path);
@@ -376,7 +740,7 @@ gboolean mce_conf_init(void)
 		while ((direntry = readdir(dir)) != NULL && telldir(dir)) {
 			if ((direntry->d_type == DT_REG || direntry->d_type == DT_LNK) && 
 				mce_conf_is_ini_file(direntry->d_name))
-				++mce_conf_file_count;
+				++file_count;
 		}
 		rewinddir(dir);
 	} else {
@@ -384,47 +748,69 @@ gboolean mce_conf_init(void)
 	}
 	g_free(override_dir_path);
 
-	conf_files = calloc(mce_conf_file_count, sizeof(*conf_files));
+	files = calloc(file_count, sizeof(*files));
+	if (files == NULL) {
+		mce_log(LL_ERR, "mce-conf: failed to allocate the config file table");
+		goto FAIL;
+	}
 	
-	conf_files[0].filename = g_strdup(G_STRINGIFY(MCE_CONF_FILE));
-	conf_files[0].path     = g_strconcat(G_STRINGIFY(MCE_CONF_DIR), "/", 
+	files[0].filename = g_strdup(G_STRINGIFY(MCE_CONF_FILE));
+	files[0].path     = g_strconcat(G_STRINGIFY(MCE_CONF_DIR), "/", 
 										 G_STRINGIFY(MCE_CONF_FILE), NULL);
-	gpointer main_conf_file = mce_conf_read_conf_file(conf_files[0].path);
-	if (main_conf_file == NULL) {
+	files[0].keyfile  = mce_conf_read_conf_file(files[0].path);
+	if (files[0].keyfile == NULL) {
 		mce_log(LL_ERR, "mce-conf: failed to open main config file %s %s", 
-				conf_files[0].path, g_strerror(errno));
-		g_free(conf_files[0].filename);
-		g_free(conf_files[0].path);
-		free(conf_files);
-		conf_files = NULL;
-		return FALSE;
+				files[0].path, g_strerror(errno));
+		goto FAIL;
 	}
-	conf_files[0].keyfile = main_conf_file;
 
 	if (dir) {
 		size_t i = 1;
 		direntry = readdir(dir);
-		while (direntry != NULL && i < mce_conf_file_count && telldir(dir)) {
+		while (direntry != NULL && i < file_count && telldir(dir)) {
 			if ((direntry->d_type == DT_REG || direntry->d_type == DT_LNK) && 
 				mce_conf_is_ini_file(direntry->d_name)) {
-				conf_files[i].filename = g_strdup(direntry->d_name);
-				conf_files[i].path     = g_strconcat(G_STRINGIFY(MCE_CONF_DIR), "/", 
+				files[i].filename = g_strdup(direntry->d_name);
+				files[i].path     = g_strconcat(G_STRINGIFY(MCE_CONF_DIR), "/", 
 											G_STRINGIFY(MCE_CONF_OVERRIDE_DIR), "/", 
-											conf_files[i].filename, NULL);
-				conf_files[i].keyfile  = mce_conf_read_conf_file(conf_files[i].path);
+											files[i].filename, NULL);
+				files[i].keyfile  = mce_conf_read_conf_file(files[i].path);
 				 ++i;
 			}
 			direntry = readdir(dir);
 		}
 		closedir(dir);
+		dir = NULL;
 		
-		qsort(conf_files, mce_conf_file_count, sizeof(*conf_files), &mce_conf_compare_file_prio);
+		qsort(files, file_count, sizeof(*files), &mce_conf_compare_file_prio);
 	}
 	
-	for (size_t i = 0; i < mce_conf_file_count; ++i)
-		mce_log(LL_DEBUG, "mce-conf: found conf file %lu: %s", (unsigned long)i, conf_files[i].filename);
+	for (size_t i = 0; i < file_count; ++i)
+		mce_log(LL_DEBUG, "mce-conf: found conf file %lu: %s", (unsigned long)i, files[i].filename);
 
-	return TRUE;
+	*count = file_count;
+
+	return files;
+
+FAIL:
+	if (dir != NULL)
+		closedir(dir);
+
+	mce_conf_free_files(files, file_count);
+
+	return NULL;
+}
+
+/**
+ * Init function for the mce-conf component
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_conf_init(void)
+{
+	conf_files = mce_conf_load_files(&mce_conf_file_count);
+
+	return (conf_files != NULL);
 }
 
 /**
@@ -432,14 +818,37 @@ gboolean mce_conf_init(void)
  */
 void mce_conf_exit(void)
 {
-	for (size_t i = 0; i < mce_conf_file_count; ++i) {
-		if (conf_files[i].filename)
-			g_free(conf_files[i].filename);
-		if (conf_files[i].path)
-			g_free(conf_files[i].path);
-		
-		mce_conf_free_conf_file(conf_files[i].keyfile);
-	}
+	mce_conf_free_files(conf_files, mce_conf_file_count);
+	conf_files = NULL;
+	mce_conf_file_count = 0;
 
 	return;
 }
+
+/**
+ * Re-read the configuration files and fill in the bound settings again;
+ * other values already read by the modules only change
+ * if the modules read them again
+ *
+ * The new configuration replaces the current one only if it could
+ * be read; otherwise the current configuration is kept
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_conf_reload(void)
+{
+	struct mce_conf_file *files;
+	size_t count;
+
+	if ((files = mce_conf_load_files(&count)) == NULL)
+		return FALSE;
+
+	mce_conf_exit();
+
+	conf_files = files;
+	mce_conf_file_count = count;
+
+	g_slist_foreach(bound_settings, mce_conf_fill_bound, NULL);
+
+	return TRUE;
+}
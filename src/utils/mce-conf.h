@@ -24,6 +24,70 @@
 
 #include <glib.h>
 
+/** Types of configuration values bound to settings fields */
+typedef enum {
+	/** gboolean */
+	MCE_CONF_TYPE_BOOL = 0,
+	/** gint */
+	MCE_CONF_TYPE_INT = 1,
+	/** gchar *, owned by mce-conf */
+	MCE_CONF_TYPE_STRING = 2,
+	/** mce_conf_int_list_t, owned by mce-conf */
+	MCE_CONF_TYPE_INT_LIST = 3,
+	/** GHashTable * of every key in the group to its integer value,
+	 *  stored with GINT_TO_POINTER(); owned by mce-conf */
+	MCE_CONF_TYPE_INT_MAP = 4
+} mce_conf_type_t;
+
+/** An integer list settings field */
+typedef struct {
+	gint *values;				/**< The values, NULL if unset */
+	gsize length;				/**< Number of values */
+} mce_conf_int_list_t;
+
+/** A configuration key bound to a field of a settings struct */
+typedef struct {
+	const gchar *key;			/**< Configuration key */
+	mce_conf_type_t type;			/**< Type of the field */
+	glong offset;				/**< Offset of the field */
+	gint defaultval;			/**< Default for bool and int */
+	const gchar *defaultstr;		/**< Default for string */
+	gint min;				/**< Smallest valid integer */
+	gint max;				/**< Largest valid integer */
+} mce_conf_binding_t;
+
+/** Bind a boolean key to a field */
+#define MCE_CONF_BIND_BOOL(type, field, key, defaultval) \
+	{ (key), MCE_CONF_TYPE_BOOL, G_STRUCT_OFFSET(type, field), \
+	  (defaultval), NULL, 0, 0 }
+
+/** Bind an integer key, valid from min to max, to a field */
+#define MCE_CONF_BIND_INT(type, field, key, defaultval, min, max) \
+	{ (key), MCE_CONF_TYPE_INT, G_STRUCT_OFFSET(type, field), \
+	  (defaultval), NULL, (min), (max) }
+
+/** Bind a string key to a field */
+#define MCE_CONF_BIND_STRING(type, field, key, defaultstr) \
+	{ (key), MCE_CONF_TYPE_STRING, G_STRUCT_OFFSET(type, field), \
+	  0, (defaultstr), 0, 0 }
+
+/** Bind an integer list key, each value valid from min to max, to a field */
+#define MCE_CONF_BIND_INT_LIST(type, field, key, min, max) \
+	{ (key), MCE_CONF_TYPE_INT_LIST, G_STRUCT_OFFSET(type, field), \
+	  0, NULL, (min), (max) }
+
+/** Key of a binding that covers every key of the group */
+#define MCE_CONF_ANY_KEY		"*"
+
+/** Bind every key of the group, as integers valid from min to max, to a field */
+#define MCE_CONF_BIND_INT_MAP(type, field, min, max) \
+	{ MCE_CONF_ANY_KEY, MCE_CONF_TYPE_INT_MAP, \
+	  G_STRUCT_OFFSET(type, field), 0, NULL, (min), (max) }
+
+/** End of a binding table */
+#define MCE_CONF_BIND_END \
+	{ NULL, MCE_CONF_TYPE_BOOL, 0, 0, NULL, 0, 0 }
+
 gboolean mce_conf_get_bool(const gchar *group, const gchar *key,
 			   const gboolean defaultval, gpointer keyfileptr);
 gboolean mce_conf_set_bool(const gchar *group, const gchar *key,
@@ -39,9 +103,14 @@ gchar *mce_conf_get_string(const gchar *group, const gchar *key,
 gchar **mce_conf_get_string_list(const gchar *group, const gchar *key,
 				 gsize *length, gpointer keyfileptr);
 
+void mce_conf_bind(const gchar *group,
+		   const mce_conf_binding_t *bindings, gpointer settings);
+void mce_conf_unbind(gpointer settings);
+
 gpointer mce_conf_read_conf_file(const gchar *const conffile);
 void mce_conf_free_conf_file(gpointer keyfileptr);
 
 gboolean mce_conf_init(void);
+gboolean mce_conf_reload(void);
 void mce_conf_exit(void);
 #endif /* _MCE_CONF_H_ */
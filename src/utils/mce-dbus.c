@@ -403,6 +403,102 @@ EXIT:
 	return status;
 }
 
+/**
+ * D-Bus callback for the set log verbosity method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean log_verbosity_set_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	dbus_int32_t verbosity = LL_DEFAULT;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_INT32, &verbosity,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"Failed to get argument from %s.%s; %s",
+			MCE_REQUEST_IF, MCE_LOG_VERBOSITY_SET,
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	mce_log_set_verbosity(CLAMP(verbosity, LL_NONE, LL_DEBUG));
+
+	if (no_reply == FALSE)
+		status = dbus_send_message(dbus_new_method_reply(msg));
+	else
+		status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for the add log pattern method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean log_pattern_add_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	const char *pattern = NULL;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &pattern,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"Failed to get argument from %s.%s; %s",
+			MCE_REQUEST_IF, MCE_LOG_PATTERN_ADD_REQ,
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	if (mce_log_add_pattern(pattern) == 0)
+		mce_log(LL_INFO, "Logging call sites matching `%s'", pattern);
+	else
+		mce_log(LL_WARN, "Too many log patterns; ignoring `%s'",
+			pattern);
+
+	if (no_reply == FALSE)
+		status = dbus_send_message(dbus_new_method_reply(msg));
+	else
+		status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for the clear log patterns method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean log_patterns_clear_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+
+	mce_log_clear_patterns();
+
+	if (no_reply == FALSE)
+		return dbus_send_message(dbus_new_method_reply(msg));
+
+	return TRUE;
+}
+
 /**
  * D-Bus message handler
  *
@@ -840,6 +936,37 @@ void mce_dbus_owner_monitor_remove_all(GSList **monitor_list)
 	}
 }
 
+/**
+ * Log the D-Bus handlers and owner monitors, for diagnostics
+ */
+void mce_dbus_dump(void)
+{
+	guint monitors = 0;
+
+	mce_log(LL_DUMP, "%u D-Bus handlers", g_slist_length(dbus_handlers));
+
+	for (GSList *item = dbus_handlers; item != NULL; item = item->next) {
+		handler_struct *hs = item->data;
+
+		/* Owner monitors are NameOwnerChanged handlers on a name */
+		if ((hs->type == DBUS_MESSAGE_TYPE_SIGNAL) &&
+		    (strcmp(hs->name, "NameOwnerChanged") == 0) &&
+		    (hs->rules != NULL)) {
+			mce_log(LL_DUMP, "  owner monitor: %s", hs->rules);
+			monitors++;
+			continue;
+		}
+
+		mce_log(LL_DUMP, "  %s %s.%s%s%s",
+			(hs->type == DBUS_MESSAGE_TYPE_SIGNAL) ? "signal" :
+								 "method",
+			hs->interface, hs->name,
+			hs->rules ? "; " : "", hs->rules ? hs->rules : "");
+	}
+
+	mce_log(LL_DUMP, "%u D-Bus owner monitors", monitors);
+}
+
 /**
  * Acquire D-Bus services
  *
@@ -946,6 +1073,30 @@ gboolean mce_dbus_init(const gboolean systembus)
 				 version_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* set_log_verbosity */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_LOG_VERBOSITY_SET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 log_verbosity_set_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* req_log_pattern_add */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_LOG_PATTERN_ADD_REQ,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 log_pattern_add_dbus_cb) == NULL)
+		goto EXIT;
+
+	/* req_log_patterns_clear */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_LOG_PATTERNS_CLEAR_REQ,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 log_patterns_clear_dbus_cb) == NULL)
+		goto EXIT;
+
 	status = TRUE;
 
 EXIT:
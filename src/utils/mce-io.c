@@ -915,3 +915,19 @@ int mce_get_io_monitor_fd(gconstpointer io_monitor)
 
 	return iomon->fd;
 }
+
+/**
+ * Log the registered I/O monitors, for diagnostics
+ */
+void mce_io_dump(void)
+{
+	mce_log(LL_DUMP, "%u I/O monitors", g_slist_length(file_monitors));
+
+	for (GSList *item = file_monitors; item != NULL; item = item->next) {
+		iomon_struct *iomon = item->data;
+
+		mce_log(LL_DUMP, "  fd %d: %s; %s%s", iomon->fd, iomon->file,
+			(iomon->type == IOMON_CHUNK) ? "chunk" : "string",
+			iomon->suspended ? ", suspended" : "");
+	}
+}
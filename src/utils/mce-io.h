@@ -70,5 +70,6 @@ void mce_unregister_io_monitor(gconstpointer io_monitor);
 gboolean mcs_io_monitor_seek_to_end(gconstpointer io_monitor);
 const gchar *mce_get_io_monitor_name(gconstpointer io_monitor);
 int mce_get_io_monitor_fd(gconstpointer io_monitor);
+void mce_io_dump(void);
 
 #endif /* _MCE_IO_H_ */
@@ -23,56 +23,67 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fnmatch.h>
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif /* _BSD_SOURCE */
 #include <syslog.h>
 #include "mce-log.h"
 
-static unsigned int logverbosity = LL_WARN;	/**< Log verbosity */
+unsigned int mce_log_verbosity = LL_WARN;	/**< Log verbosity */
+unsigned int mce_log_generation = 0;		/**< Call site patterns */
 static int logtype = MCE_LOG_SYSLOG;		/**< Output for log messages */
 static char *logname = NULL;
 
+/** Largest number of call site patterns */
+#define MAX_PATTERNS	32
+
+/** Patterns of call sites that log regardless of verbosity */
+static char **patterns = NULL;
+static size_t pattern_count = 0;
+/** Last generation handed out; generations are never reused */
+static unsigned int pattern_serial = 0;
+
 /**
+ * Write a message to the log; use mce_log(), which checks
+ * the log verbosity before evaluating any arguments
  *
  * @param loglevel The level of severity for this message
  * @param fmt The format string for this message
  * @param ... Input to the format string
  */
-void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
+void mce_log_file(const loglevel_t loglevel, const char *const fmt, ...)
 {
 	va_list args;
 
 	va_start(args, fmt);
 
-	if (logverbosity >= loglevel) {
-		if (logtype == MCE_LOG_STDERR) {
-			fprintf(stderr, "%s: ", logname);
-			vfprintf(stderr, fmt, args);
-			fprintf(stderr, "\n");
-		} else {
-			switch (loglevel) {
-				case LL_DEBUG:
-					vsyslog(LOG_DEBUG, fmt, args);
-					break;
-
-				case LL_ERR:
-					vsyslog(LOG_ERR, fmt, args);
-					break;
-
-				case LL_CRIT:
-					vsyslog(LOG_CRIT, fmt, args);
-					break;
-
-				case LL_INFO:
-					vsyslog(LOG_INFO, fmt, args);
-					break;
-
-				case LL_WARN:
-				default:
-					vsyslog(LOG_WARNING, fmt, args);
-													break;
-			}
+	if (logtype == MCE_LOG_STDERR) {
+		fprintf(stderr, "%s: ", logname);
+		vfprintf(stderr, fmt, args);
+		fprintf(stderr, "\n");
+	} else {
+		switch (loglevel) {
+			case LL_DEBUG:
+				vsyslog(LOG_DEBUG, fmt, args);
+				break;
+
+			case LL_ERR:
+				vsyslog(LOG_ERR, fmt, args);
+				break;
+
+			case LL_CRIT:
+				vsyslog(LOG_CRIT, fmt, args);
+				break;
+
+			case LL_INFO:
+				vsyslog(LOG_INFO, fmt, args);
+				break;
+
+			case LL_WARN:
+			default:
+				vsyslog(LOG_WARNING, fmt, args);
+				break;
 		}
 	}
 
@@ -87,7 +98,96 @@ void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
  */
 void mce_log_set_verbosity(const int verbosity)
 {
-	logverbosity = verbosity;
+	mce_log_verbosity = verbosity;
+}
+
+/**
+ * Recheck whether a call site matches any call site pattern;
+ * called by mce_log_p() once per call site after the patterns change
+ *
+ * @param site The call site
+ * @return 1 if the call site logs regardless of verbosity, 0 otherwise
+ */
+int mce_log_site_enabled(mce_log_site_t *const site)
+{
+	const char *file = strrchr(site->file, '/');
+	char *name = NULL;
+	size_t i;
+
+	file = (file != NULL) ? file + 1 : site->file;
+	site->enabled = 0;
+	site->generation = mce_log_generation;
+
+	if (asprintf(&name, "%s:%s", file, site->func) < 0)
+		goto EXIT;
+
+	for (i = 0; i < pattern_count; i++) {
+		if (fnmatch(patterns[i], name, 0) == 0) {
+			site->enabled = 1;
+			break;
+		}
+	}
+
+	free(name);
+
+EXIT:
+	return site->enabled;
+}
+
+/**
+ * Make the call sites matching a pattern log regardless of verbosity
+ *
+ * @param pattern A shell wildcard pattern matched against
+ *                "file:function", for example "display.c:*"
+ * @return 0 on success or if the pattern is already added,
+ *         -1 if there are too many patterns or memory ran out
+ */
+int mce_log_add_pattern(const char *const pattern)
+{
+	char **tmp;
+	char *copy;
+	size_t i;
+
+	for (i = 0; i < pattern_count; i++) {
+		if (strcmp(patterns[i], pattern) == 0)
+			return 0;
+	}
+
+	if (pattern_count >= MAX_PATTERNS)
+		return -1;
+
+	tmp = realloc(patterns, (pattern_count + 1) * sizeof (*tmp));
+	copy = strdup(pattern);
+
+	if (tmp == NULL || copy == NULL) {
+		free(copy);
+		patterns = (tmp != NULL) ? tmp : patterns;
+		return -1;
+	}
+
+	patterns = tmp;
+	patterns[pattern_count++] = copy;
+
+	/* Make every call site recheck the patterns */
+	if (++pattern_serial == 0)
+		++pattern_serial;
+
+	mce_log_generation = pattern_serial;
+
+	return 0;
+}
+
+/**
+ * Remove all call site patterns
+ */
+void mce_log_clear_patterns(void)
+{
+	while (pattern_count > 0)
+		free(patterns[--pattern_count]);
+
+	free(patterns);
+	patterns = NULL;
+	mce_log_generation = 0;
 }
 
 /**
@@ -115,6 +215,8 @@ void mce_log_close(void)
 	if (logname)
 		free(logname);
 
+	mce_log_clear_patterns();
+
 	if (logtype == MCE_LOG_SYSLOG)
 		closelog();
 }
@@ -34,13 +34,82 @@ typedef enum {
 	LL_ERR = 2,			/**< Error */
 	LL_WARN = 3,			/**< Warning */
 	LL_DEFAULT = LL_WARN,		/**< Default log level */
+	LL_DUMP = LL_WARN,		/**< State dumps; shown by default */
 	LL_INFO = 4,			/**< Informational message */
 	LL_DEBUG = 5			/**< Useful when debugging */
 } loglevel_t;
 
-void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
+/**
+ * Highest loglevel compiled in; building with
+ * -DMCE_LOG_MAX_LEVEL=LL_INFO compiles out all debug logging,
+ * including the evaluation of its arguments
+ */
+#ifndef MCE_LOG_MAX_LEVEL
+#define MCE_LOG_MAX_LEVEL		LL_DEBUG
+#endif /* MCE_LOG_MAX_LEVEL */
+
+/** Logging state of a single mce_log() call site */
+typedef struct {
+	const char *file;		/**< Source file of the call site */
+	const char *func;		/**< Function of the call site */
+	unsigned int generation;	/**< Pattern generation of enabled */
+	int enabled;			/**< Log regardless of verbosity? */
+} mce_log_site_t;
+
+/** Current log verbosity; use mce_log_set_verbosity() to change it */
+extern unsigned int mce_log_verbosity;
+
+/** Generation of the call site patterns, 0 when there are none */
+extern unsigned int mce_log_generation;
+
+int mce_log_site_enabled(mce_log_site_t *const site);
+
+/**
+ * Check whether a message would be logged,
+ * without a function call unless call site patterns are in use
+ *
+ * @param loglevel The level of severity of the message
+ * @param site The call site
+ * @return 1 if the message should be logged, 0 otherwise
+ */
+static inline int mce_log_p(const loglevel_t loglevel,
+			    mce_log_site_t *const site)
+{
+	if ((unsigned int)loglevel <= mce_log_verbosity)
+		return 1;
+
+	if (mce_log_generation == 0)
+		return 0;
+
+	if (site->generation != mce_log_generation)
+		return mce_log_site_enabled(site);
+
+	return site->enabled;
+}
+
+/**
+ * Log a message; the arguments are only evaluated
+ * if the message is going to be logged
+ *
+ * @param LEV The level of severity for this message
+ * @param FMT The format string for this message
+ * @param ... Input to the format string
+ */
+#define mce_log(LEV, FMT, ...)						\
+	do {								\
+		static mce_log_site_t mce_log_site_ = {			\
+			__FILE__, __func__, 0, 0			\
+		};							\
+		if ((LEV) <= MCE_LOG_MAX_LEVEL &&			\
+		    mce_log_p((LEV), &mce_log_site_))			\
+			mce_log_file((LEV), (FMT), ##__VA_ARGS__);	\
+	} while (0)
+
+void mce_log_file(const loglevel_t loglevel, const char *const fmt, ...)
 	__attribute__((format(printf, 2, 3)));
 void mce_log_set_verbosity(const int verbosity);
+int mce_log_add_pattern(const char *const pattern);
+void mce_log_clear_patterns(void);
 void mce_log_open(const char *const name, const int facility, const int type);
 void mce_log_close(void);
 
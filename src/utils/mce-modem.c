@@ -0,0 +1,495 @@
+#include "mce-modem.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "mce-log.h"
+
+/** Largest response line kept while waiting for its end */
+#define MCE_MODEM_MAX_LINE		256
+
+/** A hint waiting to be sent to the modem */
+typedef struct {
+	/** Key of the hint; a newer hint replaces a pending one */
+	gchar *key;
+	/** AT command, including the line terminator */
+	gchar *command;
+} mce_modem_hint_t;
+
+/** A persistent AT command channel to a modem tty */
+struct mce_modem_channel {
+	/** Path to the modem tty */
+	gchar *path;
+	/** File descriptor of the tty, -1 if closed */
+	gint fd;
+	/** I/O watch for responses */
+	guint io_watch_id;
+	/** Acknowledgement timeout */
+	guint ack_timeout_id;
+	/** Delayed reopen after an error */
+	guint reopen_id;
+	/** Current reopen delay in seconds, 0 if the last attempt worked */
+	guint reopen_delay;
+	/** Partial response line */
+	GString *line;
+	/** Hints not yet sent, oldest first */
+	GQueue *pending;
+	/** Hint awaiting acknowledgement, NULL if none */
+	mce_modem_hint_t *in_flight;
+	/** Last acknowledged command, by key */
+	GHashTable *acked;
+};
+
+static void mce_modem_channel_send_next(mce_modem_channel_t *channel);
+
+/**
+ * Free a hint
+ *
+ * @param hint The hint to free
+ */
+static void mce_modem_hint_free(mce_modem_hint_t *hint)
+{
+	if (hint == NULL)
+		return;
+
+	g_free(hint->key);
+	g_free(hint->command);
+	g_free(hint);
+}
+
+/**
+ * Find a pending hint by key
+ *
+ * @param channel The channel
+ * @param key The key of the hint
+ * @return The pending hint, or NULL if there is none
+ */
+static mce_modem_hint_t *mce_modem_channel_find_pending(mce_modem_channel_t *channel,
+							const gchar *const key)
+{
+	for (GList *iter = channel->pending->head; iter; iter = iter->next) {
+		mce_modem_hint_t *hint = iter->data;
+
+		if (strcmp(hint->key, key) == 0)
+			return hint;
+	}
+
+	return NULL;
+}
+
+/**
+ * Close the modem tty
+ *
+ * @param channel The channel
+ */
+static void mce_modem_channel_close(mce_modem_channel_t *channel)
+{
+	if (channel->ack_timeout_id != 0) {
+		g_source_remove(channel->ack_timeout_id);
+		channel->ack_timeout_id = 0;
+	}
+
+	if (channel->io_watch_id != 0) {
+		g_source_remove(channel->io_watch_id);
+		channel->io_watch_id = 0;
+	}
+
+	if (channel->fd != -1) {
+		close(channel->fd);
+		channel->fd = -1;
+	}
+
+	g_string_truncate(channel->line, 0);
+}
+
+/**
+ * Timeout callback for reopening the modem tty
+ *
+ * @param data The channel
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean mce_modem_channel_reopen_cb(gpointer data)
+{
+	mce_modem_channel_t *channel = data;
+
+	channel->reopen_id = 0;
+	mce_modem_channel_send_next(channel);
+
+	return FALSE;
+}
+
+/**
+ * Close the modem tty after an error and retry later;
+ * the hint in flight is sent again unless a newer one replaced it
+ *
+ * The retry delay doubles with each failure; once it exceeds
+ * MCE_MODEM_REOPEN_DELAY_MAX, the pending hints are kept,
+ * but nothing is retried until the next hint is set
+ *
+ * @param channel The channel
+ */
+static void mce_modem_channel_fail(mce_modem_channel_t *channel)
+{
+	mce_modem_channel_close(channel);
+
+	/* The modem may have been reset along with the tty;
+	 * don't skip any hint as already acknowledged
+	 */
+	g_hash_table_remove_all(channel->acked);
+
+	if (channel->in_flight != NULL) {
+		if (mce_modem_channel_find_pending(channel,
+						   channel->in_flight->key) != NULL)
+			mce_modem_hint_free(channel->in_flight);
+		else
+			g_queue_push_head(channel->pending, channel->in_flight);
+
+		channel->in_flight = NULL;
+	}
+
+	if (channel->reopen_id != 0)
+		goto EXIT;
+
+	if (channel->reopen_delay == 0)
+		channel->reopen_delay = MCE_MODEM_REOPEN_DELAY;
+	else
+		channel->reopen_delay *= 2;
+
+	if (channel->reopen_delay > MCE_MODEM_REOPEN_DELAY_MAX) {
+		mce_log(LL_WARN, "Giving up on `%s' until the next hint",
+			channel->path);
+		goto EXIT;
+	}
+
+	channel->reopen_id = g_timeout_add_seconds(channel->reopen_delay,
+						   mce_modem_channel_reopen_cb,
+						   channel);
+
+EXIT:
+	return;
+}
+
+/**
+ * Finish the hint in flight and send the next one
+ *
+ * @param channel The channel
+ * @param acked TRUE if the modem acknowledged the hint, FALSE otherwise
+ */
+static void mce_modem_channel_complete(mce_modem_channel_t *channel,
+				       gboolean acked)
+{
+	mce_modem_hint_t *hint = channel->in_flight;
+
+	channel->in_flight = NULL;
+
+	if (channel->ack_timeout_id != 0) {
+		g_source_remove(channel->ack_timeout_id);
+		channel->ack_timeout_id = 0;
+	}
+
+	if (acked == TRUE) {
+		g_hash_table_replace(channel->acked, hint->key, hint->command);
+		g_free(hint);
+		channel->reopen_delay = 0;
+	} else {
+		/* The modem state is unknown; don't skip a repeat */
+		g_hash_table_remove(channel->acked, hint->key);
+		mce_modem_hint_free(hint);
+	}
+
+	mce_modem_channel_send_next(channel);
+}
+
+/**
+ * Timeout callback for a missing acknowledgement
+ *
+ * The modem or the tty may be wedged; reopen it,
+ * and send the hint again unless a newer one replaced it
+ *
+ * @param data The channel
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean mce_modem_channel_ack_timeout_cb(gpointer data)
+{
+	mce_modem_channel_t *channel = data;
+
+	channel->ack_timeout_id = 0;
+
+	mce_log(LL_WARN, "No acknowledgement from `%s' for `%s'",
+		channel->path, channel->in_flight->key);
+
+	mce_modem_channel_fail(channel);
+
+	return FALSE;
+}
+
+/**
+ * Handle a complete response line from the modem
+ *
+ * @param channel The channel
+ * @param line The response line
+ */
+static void mce_modem_channel_handle_line(mce_modem_channel_t *channel,
+					  const gchar *line)
+{
+	if (channel->in_flight == NULL) {
+		mce_log(LL_DEBUG, "Unsolicited `%s' from `%s'",
+			line, channel->path);
+	} else if (g_str_has_suffix(line, "OK") == TRUE) {
+		mce_modem_channel_complete(channel, TRUE);
+	} else if (strstr(line, "ERROR") != NULL) {
+		mce_log(LL_WARN, "`%s' rejected by `%s'; %s",
+			channel->in_flight->key, channel->path, line);
+		mce_modem_channel_complete(channel, FALSE);
+	}
+}
+
+/**
+ * I/O watch callback for modem responses
+ *
+ * @param source Unused
+ * @param condition The I/O condition
+ * @param data The channel
+ * @return TRUE to keep the watch, FALSE to remove it
+ */
+static gboolean mce_modem_channel_io_cb(GIOChannel *source,
+					GIOCondition condition,
+					gpointer data)
+{
+	mce_modem_channel_t *channel = data;
+	gchar buf[MCE_MODEM_MAX_LINE];
+	ssize_t len;
+
+	(void)source;
+
+	if ((condition & G_IO_IN) != 0) {
+		len = read(channel->fd, buf, sizeof (buf));
+
+		if (len > 0) {
+			for (ssize_t i = 0; i < len; i++) {
+				if (buf[i] != '\r' && buf[i] != '\n') {
+					if (channel->line->len < MCE_MODEM_MAX_LINE)
+						g_string_append_c(channel->line,
+								  buf[i]);
+					continue;
+				}
+
+				if (channel->line->len == 0)
+					continue;
+
+				mce_modem_channel_handle_line(channel,
+							      channel->line->str);
+				g_string_truncate(channel->line, 0);
+
+				/* Handling the line may have closed the tty */
+				if (channel->fd == -1)
+					return FALSE;
+			}
+
+			return TRUE;
+		}
+
+		if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+			errno = 0;
+			return TRUE;
+		}
+	}
+
+	mce_log(LL_WARN, "Lost connection to `%s'", channel->path);
+
+	/* The watch goes away with the return value */
+	channel->io_watch_id = 0;
+	mce_modem_channel_fail(channel);
+
+	return FALSE;
+}
+
+/**
+ * Open the modem tty, unless already open
+ *
+ * @param channel The channel
+ * @return TRUE if the tty is open, FALSE on failure
+ */
+static gboolean mce_modem_channel_open(mce_modem_channel_t *channel)
+{
+	struct termios tio;
+	GIOChannel *iochan;
+
+	if (channel->fd != -1)
+		return TRUE;
+
+	if ((channel->fd = open(channel->path,
+				O_RDWR | O_NOCTTY | O_NONBLOCK)) == -1) {
+		mce_log(LL_WARN, "Failed to open `%s'; %s",
+			channel->path, g_strerror(errno));
+		errno = 0;
+		return FALSE;
+	}
+
+	/* Raw mode, so responses are not echoed back or mangled */
+	if (tcgetattr(channel->fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		(void)tcsetattr(channel->fd, TCSANOW, &tio);
+		(void)tcflush(channel->fd, TCIFLUSH);
+	}
+
+	errno = 0;
+
+	iochan = g_io_channel_unix_new(channel->fd);
+	channel->io_watch_id = g_io_add_watch(iochan,
+					      G_IO_IN | G_IO_HUP |
+					      G_IO_ERR | G_IO_NVAL,
+					      mce_modem_channel_io_cb, channel);
+	g_io_channel_unref(iochan);
+
+	return TRUE;
+}
+
+/**
+ * Send the next pending hint, unless one is awaiting acknowledgement
+ *
+ * @param channel The channel
+ */
+static void mce_modem_channel_send_next(mce_modem_channel_t *channel)
+{
+	mce_modem_hint_t *hint;
+	const gchar *acked;
+	gsize len;
+
+	while (channel->in_flight == NULL &&
+	       channel->reopen_id == 0 &&
+	       (hint = g_queue_peek_head(channel->pending)) != NULL) {
+		/* Skip hints the modem is already known to be in */
+		acked = g_hash_table_lookup(channel->acked, hint->key);
+
+		if (g_strcmp0(acked, hint->command) == 0) {
+			mce_modem_hint_free(g_queue_pop_head(channel->pending));
+			continue;
+		}
+
+		if (mce_modem_channel_open(channel) == FALSE) {
+			mce_modem_channel_fail(channel);
+			break;
+		}
+
+		channel->in_flight = g_queue_pop_head(channel->pending);
+		len = strlen(hint->command);
+
+		if (write(channel->fd, hint->command, len) != (ssize_t)len) {
+			mce_log(LL_WARN, "Failed to write `%s' to `%s'",
+				hint->key, channel->path);
+			errno = 0;
+			mce_modem_channel_fail(channel);
+			break;
+		}
+
+		mce_log(LL_DEBUG, "Sent `%s' to `%s'", hint->key, channel->path);
+
+		channel->ack_timeout_id =
+			g_timeout_add(MCE_MODEM_ACK_TIMEOUT,
+				      mce_modem_channel_ack_timeout_cb,
+				      channel);
+	}
+}
+
+/**
+ * Create a modem channel; the tty is opened when the first hint is sent,
+ * and kept open from then on
+ *
+ * @param path Path to the modem tty
+ * @return A new channel; free with mce_modem_channel_free()
+ */
+mce_modem_channel_t *mce_modem_channel_new(const gchar *const path)
+{
+	mce_modem_channel_t *channel = g_new0(mce_modem_channel_t, 1);
+
+	channel->path = g_strdup(path);
+	channel->fd = -1;
+	channel->line = g_string_new(NULL);
+	channel->pending = g_queue_new();
+	channel->acked = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       g_free, g_free);
+
+	return channel;
+}
+
+/**
+ * Queue a hint for the modem
+ *
+ * Commands are sent one at a time, each waiting for the modem
+ * to answer OK or ERROR; a hint replaces a pending hint with the same
+ * key, so rapid changes collapse into the final one, and a hint
+ * matching the last acknowledged command for its key is not sent;
+ * a channel that gave up reopening the tty tries again at once
+ *
+ * @param channel The channel
+ * @param key Key of the hint, for example the AT command name
+ * @param command AT command, including the line terminator
+ */
+void mce_modem_channel_set_hint(mce_modem_channel_t *channel,
+				const gchar *const key,
+				const gchar *const command)
+{
+	mce_modem_hint_t *hint;
+
+	if ((hint = mce_modem_channel_find_pending(channel, key)) != NULL) {
+		g_free(hint->command);
+		hint->command = g_strdup(command);
+	} else {
+		hint = g_new0(mce_modem_hint_t, 1);
+		hint->key = g_strdup(key);
+		hint->command = g_strdup(command);
+		g_queue_push_tail(channel->pending, hint);
+	}
+
+	if (channel->reopen_delay > MCE_MODEM_REOPEN_DELAY_MAX)
+		channel->reopen_delay = 0;
+
+	mce_modem_channel_send_next(channel);
+}
+
+/**
+ * Close and free a modem channel; pending hints are written
+ * without waiting for acknowledgement
+ *
+ * @param channel The channel
+ */
+void mce_modem_channel_free(mce_modem_channel_t *channel)
+{
+	mce_modem_hint_t *hint;
+
+	if (channel == NULL)
+		return;
+
+	while ((hint = g_queue_pop_head(channel->pending)) != NULL) {
+		const gchar *acked = g_hash_table_lookup(channel->acked,
+							 hint->key);
+
+		if (g_strcmp0(acked, hint->command) != 0 &&
+		    mce_modem_channel_open(channel) == TRUE &&
+		    write(channel->fd, hint->command,
+			  strlen(hint->command)) < 0) {
+			mce_log(LL_WARN, "Failed to write `%s' to `%s'",
+				hint->key, channel->path);
+			errno = 0;
+		}
+
+		mce_modem_hint_free(hint);
+	}
+
+	mce_modem_channel_close(channel);
+
+	if (channel->reopen_id != 0)
+		g_source_remove(channel->reopen_id);
+
+	mce_modem_hint_free(channel->in_flight);
+	g_queue_free_full(channel->pending,
+			  (GDestroyNotify)mce_modem_hint_free);
+	g_hash_table_destroy(channel->acked);
+	g_string_free(channel->line, TRUE);
+	g_free(channel->path);
+	g_free(channel);
+}
@@ -0,0 +1,28 @@
+#ifndef _MCE_MODEM_H_
+#define _MCE_MODEM_H_
+
+#include <glib.h>
+
+/** Time in milliseconds to wait for the modem to acknowledge a command */
+#define MCE_MODEM_ACK_TIMEOUT		2000
+
+/** Time in seconds before reopening a modem channel after an error */
+#define MCE_MODEM_REOPEN_DELAY		5
+
+/**
+ * Longest time in seconds before reopening a modem channel;
+ * the delay doubles with each failed attempt, and once it would
+ * exceed this, the channel waits for the next hint instead
+ */
+#define MCE_MODEM_REOPEN_DELAY_MAX	320
+
+/** A persistent AT command channel to a modem tty */
+typedef struct mce_modem_channel mce_modem_channel_t;
+
+mce_modem_channel_t *mce_modem_channel_new(const gchar *const path);
+void mce_modem_channel_set_hint(mce_modem_channel_t *channel,
+				const gchar *const key,
+				const gchar *const command);
+void mce_modem_channel_free(mce_modem_channel_t *channel);
+
+#endif /* _MCE_MODEM_H_ */
@@ -21,14 +21,63 @@
  */
 #include <glib.h>
 #include <gmodule.h>
+#include <string.h>
 #include "mce.h"
 #include "mce-modules.h"
 #include "mce-log.h"
 #include "mce-conf.h"
+#include "datapipe.h"
+
+/** Optional module function called when leaving the active states */
+#define MCE_MODULE_QUIESCE_SYMBOL	"mce_module_quiesce"
+
+/** Optional module function called when re-entering the active states */
+#define MCE_MODULE_RESUME_SYMBOL	"mce_module_resume"
+
+/** Optional module function logging its state, for diagnostics */
+#define MCE_MODULE_DUMP_SYMBOL		"mce_module_dump"
+
+/** Optional module function re-reading its configuration */
+#define MCE_MODULE_RELOAD_SYMBOL	"mce_module_reload"
+
+/** Path to the open file descriptors of MCE */
+#define MCE_PROC_FD_PATH		"/proc/self/fd"
+
+/** Path to the process status of MCE */
+#define MCE_PROC_STATUS_PATH		"/proc/self/status"
+
+/** Module activity profile hook */
+typedef void (*module_activity_hook_t)(void);
 
 /** List of all loaded modules */
 static GSList *modules = NULL;
 
+/** List of modules quiesced in the current system state */
+static GSList *quiesced_modules = NULL;
+
+/** Names of the modules to load after readiness has been signalled */
+static GSList *pending_modules = NULL;
+
+/** Modules loaded before readiness when no list is configured */
+static const gchar *const default_critical_modules[] = {
+	"rtconf-ini",
+	"rtconf-gconf",
+	"display",
+	NULL
+};
+
+/** ID for the activity profile update idle source */
+static guint activity_profile_cb_id = 0;
+
+/** System state of the current activity profile */
+static system_state_t profile_state = MCE_STATE_UNDEF;
+
+/** Start of the current activity profile, in monotonic microseconds */
+static gint64 profile_start_time = 0;
+
+/** Wakeups at the start of the current activity profile */
+static gint64 profile_start_wakeups = -1;
+
 static gboolean mce_modules_check_provides(module_info_struct *new_module_info)
 {
 	for (GSList *module = modules; module; module = module->next) {
@@ -76,7 +125,181 @@ static gboolean mce_modules_check_essential(void)
 	return TRUE;
 }
 
-static void mce_modules_load(gchar **modlist)
+/**
+ * Get the number of file descriptors MCE has open
+ *
+ * @return The number of open file descriptors, -1 on failure
+ */
+static gint mce_modules_count_fds(void)
+{
+	GDir *dir;
+	gint count = 0;
+
+	if ((dir = g_dir_open(MCE_PROC_FD_PATH, 0, NULL)) == NULL)
+		return -1;
+
+	while (g_dir_read_name(dir) != NULL)
+		count++;
+
+	g_dir_close(dir);
+
+	/* Don't count the descriptor used for the listing */
+	return count - 1;
+}
+
+/**
+ * Get the number of times MCE has woken up,
+ * as counted by voluntary context switches
+ *
+ * @return The number of wakeups, -1 on failure
+ */
+static gint64 mce_modules_count_wakeups(void)
+{
+	static const gchar key[] = "voluntary_ctxt_switches:";
+	gchar *status = NULL;
+	gchar *tmp;
+	gint64 wakeups = -1;
+
+	if (g_file_get_contents(MCE_PROC_STATUS_PATH, &status,
+				NULL, NULL) == FALSE)
+		goto EXIT;
+
+	/* Skip nonvoluntary_ctxt_switches, which has the key as suffix */
+	for (tmp = status; (tmp = strstr(tmp, key)) != NULL; tmp++) {
+		if ((tmp == status) || (tmp[-1] == '\n')) {
+			wakeups = g_ascii_strtoll(tmp + strlen(key), NULL, 10);
+			break;
+		}
+	}
+
+EXIT:
+	g_free(status);
+
+	return wakeups;
+}
+
+/**
+ * Log the wakeups and open file descriptors of the activity profile
+ * that is being left, and start accounting for the next one
+ *
+ * @param state The system state of the next activity profile
+ */
+static void mce_modules_report_profile(system_state_t state)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 wakeups = mce_modules_count_wakeups();
+
+	if ((profile_start_wakeups >= 0) && (wakeups >= 0)) {
+		gint64 ms = (now - profile_start_time) / 1000;
+
+		mce_log(LL_INFO,
+			"Activity profile for state %d: %" G_GINT64_FORMAT
+			" wakeups in %" G_GINT64_FORMAT " ms, %d fds open",
+			profile_state, wakeups - profile_start_wakeups,
+			ms, mce_modules_count_fds());
+	}
+
+	profile_state = state;
+	profile_start_time = now;
+	profile_start_wakeups = wakeups;
+}
+
+/**
+ * Quiesce or resume a module according to its declared active states
+ *
+ * @param module The module
+ * @param state The new system state
+ */
+static void mce_modules_update_activity(GModule *module, system_state_t state)
+{
+	module_activity_hook_t hook = NULL;
+	module_info_struct *module_info;
+	gpointer mip = NULL;
+	gboolean active;
+	gboolean quiesced;
+
+	if (g_module_symbol(module, "module_info", &mip) == FALSE)
+		goto EXIT;
+
+	module_info = (module_info_struct *)mip;
+
+	/* Modules without declared states are always active */
+	if (module_info->active_states == 0)
+		goto EXIT;
+
+	active = ((state == MCE_STATE_UNDEF) ||
+		  ((module_info->active_states & MCE_STATE_MASK(state)) != 0));
+	quiesced = (g_slist_find(quiesced_modules, module) != NULL);
+
+	if ((active == FALSE) && (quiesced == FALSE)) {
+		mce_log(LL_DEBUG, "Quiescing module %s", module_info->name);
+
+		if (g_module_symbol(module, MCE_MODULE_QUIESCE_SYMBOL,
+				    (gpointer *)&hook) == TRUE)
+			hook();
+
+		quiesced_modules = g_slist_prepend(quiesced_modules, module);
+	} else if ((active == TRUE) && (quiesced == TRUE)) {
+		mce_log(LL_DEBUG, "Resuming module %s", module_info->name);
+
+		if (g_module_symbol(module, MCE_MODULE_RESUME_SYMBOL,
+				    (gpointer *)&hook) == TRUE)
+			hook();
+
+		quiesced_modules = g_slist_remove(quiesced_modules, module);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Load a module
+ *
+ * @param path The module directory
+ * @param name The name of the module, without the "lib" prefix
+ */
+static void mce_modules_load_one(const gchar *path, const gchar *name)
+{
+	GModule *module;
+	gchar *tmp = g_module_build_path(path, name);
+
+	mce_log(LL_DEBUG, "Loading module: %s from %s", name, path);
+
+	if ((module = g_module_open(tmp, 0)) != NULL) {
+		gpointer mip = NULL;
+		gboolean blockLoad = FALSE;
+
+		if (g_module_symbol(module, "module_info", &mip) == FALSE) {
+			mce_log(LL_ERR, "Failed to retrieve module information for: %s", name);
+			g_module_close(module);
+			blockLoad = TRUE;
+		} else if (!mce_modules_check_provides((module_info_struct*)mip)) {
+			g_module_close(module);
+			blockLoad = TRUE;
+		}
+
+		if (!blockLoad) {
+			modules = g_slist_append(modules, module);
+
+			/* Modules loaded late join the current profile */
+			mce_modules_update_activity(module, profile_state);
+		}
+	} else {
+		mce_log(LL_WARN, "Failed to load module %s: %s; skipping", name, g_module_error());
+	}
+
+	g_free(tmp);
+}
+
+/**
+ * Load modules
+ *
+ * @param modlist The names of the modules
+ * @param critical The modules to load now, leaving the others pending;
+ *                 NULL to load all modules now
+ */
+static void mce_modules_load(gchar **modlist, const gchar *const *critical)
 {
 	gchar *path = NULL;
 	int i;
@@ -87,47 +310,178 @@ static void mce_modules_load(gchar **modlist)
 				   NULL);
 
 	for (i = 0; modlist[i]; i++) {
-		GModule *module;
-		gchar *tmp = g_module_build_path(path, modlist[i]);
-
-		mce_log(LL_DEBUG, "Loading module: %s from %s", modlist[i], path);
-
-		if ((module = g_module_open(tmp, 0)) != NULL) {
-			gpointer mip = NULL;
-			gboolean blockLoad = FALSE;
-
-			if (g_module_symbol(module, "module_info", &mip) == FALSE) {
-				mce_log(LL_ERR, "Failed to retrieve module information for: %s", modlist[i]);
-				g_module_close(module);
-				blockLoad = TRUE;
-			} else if (!mce_modules_check_provides((module_info_struct*)mip)) {
-				g_module_close(module);
-				blockLoad = TRUE;
-			}
-
-			if (!blockLoad)
-				modules = g_slist_append(modules, module);
-		} else {
-			mce_log(LL_WARN, "Failed to load module %s: %s; skipping", modlist[i], g_module_error());
+		if ((critical != NULL) &&
+		    (g_strv_contains(critical, modlist[i]) == FALSE)) {
+			pending_modules = g_slist_append(pending_modules,
+							 g_strdup(modlist[i]));
+			continue;
 		}
 
-		g_free(tmp);
+		mce_modules_load_one(path, modlist[i]);
 	}
 
 	g_free(path);
 }
 
+/**
+ * Apply the module activity profile of the current system state;
+ * done from idle so that modules are not quiesced from within
+ * the datapipe execution that changed the state
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the idle source
+ */
+static gboolean activity_profile_cb(gpointer data)
+{
+	system_state_t state = datapipe_get_gint(system_state_pipe);
+
+	(void)data;
+
+	activity_profile_cb_id = 0;
+
+	if (state == profile_state)
+		goto EXIT;
+
+	mce_modules_report_profile(state);
+
+	for (GSList *module = modules; module; module = module->next)
+		mce_modules_update_activity(module->data, state);
+
+	mce_log(LL_INFO,
+		"Activity profile for state %d applied; %u modules quiesced, "
+		"%d fds open", state, g_slist_length(quiesced_modules),
+		mce_modules_count_fds());
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Handle system state change
+ *
+ * @param data Unused
+ */
+static void system_state_trigger(gconstpointer data)
+{
+	(void)data;
+
+	if (activity_profile_cb_id == 0)
+		activity_profile_cb_id = g_idle_add(activity_profile_cb, NULL);
+}
+
+/**
+ * Call an optional hook of every loaded module
+ *
+ * @param symbol The name of the hook
+ * @param dump TRUE to log the module before calling its hook
+ */
+static void mce_modules_call_hook(const gchar *const symbol,
+				  const gboolean dump)
+{
+	for (GSList *module = modules; module; module = module->next) {
+		module_activity_hook_t hook = NULL;
+		gpointer mip = NULL;
+
+		if (dump == TRUE &&
+		    g_module_symbol(module->data, "module_info", &mip) == TRUE)
+			mce_log(LL_DUMP, "Module %s%s",
+				((module_info_struct *)mip)->name,
+				g_slist_find(quiesced_modules, module->data) ?
+				"; quiesced" : "");
+
+		if (g_module_symbol(module->data, symbol,
+				    (gpointer *)&hook) == TRUE)
+			hook();
+	}
+}
+
+/**
+ * Log the loaded modules and let them log their state, for diagnostics
+ */
+void mce_modules_dump(void)
+{
+	mce_log(LL_DUMP, "%u modules loaded, %d fds open",
+		g_slist_length(modules), mce_modules_count_fds());
+
+	mce_modules_call_hook(MCE_MODULE_DUMP_SYMBOL, TRUE);
+}
+
+/**
+ * Let the loaded modules re-read their configuration
+ */
+void mce_modules_reload(void)
+{
+	mce_modules_call_hook(MCE_MODULE_RELOAD_SYMBOL, FALSE);
+}
+
+/**
+ * Get the next module to load after readiness has been signalled
+ *
+ * @return The name of the module, NULL if none is pending
+ */
+const gchar *mce_modules_get_pending(void)
+{
+	return (pending_modules != NULL) ? pending_modules->data : NULL;
+}
+
+/**
+ * Load the next module pending since readiness was signalled
+ *
+ * @return TRUE on success, FALSE if the essential modules
+ *         are missing once all modules have been loaded
+ */
+gboolean mce_modules_load_pending(void)
+{
+	gchar *name;
+	gchar *path;
+
+	if (pending_modules == NULL)
+		return TRUE;
+
+	name = pending_modules->data;
+	pending_modules = g_slist_delete_link(pending_modules,
+					      pending_modules);
+
+	path = mce_conf_get_string(MCE_CONF_MODULES_GROUP,
+				   MCE_CONF_MODULES_PATH,
+				   DEFAULT_MCE_MODULE_PATH,
+				   NULL);
+	mce_modules_load_one(path, name);
+	g_free(path);
+	g_free(name);
+
+	if (pending_modules != NULL)
+		return TRUE;
+
+	return mce_modules_check_essential();
+}
+
 /**
  * Init function for the mce-modules component
  *
+ * @param early TRUE to load only the modules needed before readiness,
+ *              leaving the rest to mce_modules_load_pending()
  * @return TRUE on success, FALSE on failure
  */
-gboolean mce_modules_init(void)
+gboolean mce_modules_init(const gboolean early)
 {
 	gchar **modlist = NULL;
 	gchar **modlist_device = NULL;
 	gchar **modlist_user = NULL;
+	gchar **critical = NULL;
+	const gchar *const *filter = NULL;
 	gsize length;
+	gboolean status = TRUE;
+
+	if (early == TRUE) {
+		critical = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
+						    MCE_CONF_MODULES_CRITICAL,
+						    &length,
+						    NULL);
+		filter = (critical != NULL) ?
+			 (const gchar *const *)critical :
+			 default_critical_modules;
+	}
 
 	/* Get the list modules to load */
 	modlist = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
@@ -146,17 +500,25 @@ gboolean mce_modules_init(void)
 					   NULL);
 
 	if (modlist)
-		mce_modules_load(modlist);
+		mce_modules_load(modlist, filter);
 	if (modlist_device)
-		mce_modules_load(modlist_device);
+		mce_modules_load(modlist_device, filter);
 	if (modlist_user)
-		mce_modules_load(modlist_user);
+		mce_modules_load(modlist_user, filter);
 
 	g_strfreev(modlist);
 	g_strfreev(modlist_device);
 	g_strfreev(modlist_user);
+	g_strfreev(critical);
 
-	return mce_modules_check_essential();
+	append_output_trigger_to_datapipe(&system_state_pipe,
+					  system_state_trigger);
+
+	/* The essential modules are checked once all have been loaded */
+	if (pending_modules == NULL)
+		status = mce_modules_check_essential();
+
+	return status;
 }
 
 /**
@@ -167,6 +529,20 @@ void mce_modules_exit(void)
 	GModule *module;
 	gint i;
 
+	remove_output_trigger_from_datapipe(&system_state_pipe,
+					    system_state_trigger);
+
+	if (activity_profile_cb_id != 0) {
+		g_source_remove(activity_profile_cb_id);
+		activity_profile_cb_id = 0;
+	}
+
+	g_slist_free(quiesced_modules);
+	quiesced_modules = NULL;
+
+	g_slist_free_full(pending_modules, g_free);
+	pending_modules = NULL;
+
 	if (modules != NULL) {
 		for (i = 0; (module = g_slist_nth_data(modules, i)) != NULL; i++) {
 			g_module_close(module);
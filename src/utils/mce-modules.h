@@ -41,10 +41,23 @@
 
 #define MCE_CONF_MODULES_USRMODULES	"ModulesUser"
 
+/** Name of configuration key for signalling readiness before all modules */
+#define MCE_CONF_MODULES_EARLY_READY	"EarlyReady"
+
+/** Name of configuration key for modules to load before readiness */
+#define MCE_CONF_MODULES_CRITICAL	"CriticalModules"
+
 /** Default value for module path */
 #define DEFAULT_MCE_MODULE_PATH		"/usr/lib/mce/modules"
 
-gboolean mce_modules_init(void);
+/** Default value for signalling readiness before all modules */
+#define DEFAULT_MCE_EARLY_READY		FALSE
+
+void mce_modules_dump(void);
+void mce_modules_reload(void);
+const gchar *mce_modules_get_pending(void);
+gboolean mce_modules_load_pending(void);
+gboolean mce_modules_init(const gboolean early);
 void mce_modules_exit(void);
 
 #endif /* _MCE_MODULES_H_ */